@@ -18,7 +18,7 @@ int orange[3] = { 255, 100, 0 };
 RGBStrip Strip(5, 6, 3);
 unsigned long thecolors[5] = {NAVY, LIME, DARKRED, ORANGE, CYAN};
 unsigned long tocolors[5] = {BLACK, DARKBLUE, TEAL, SEAGREEN, BROWN};
-int thedurations[5] = {200, 100, 200, 100, 50};
+unsigned int thedurations[5] = {200, 100, 200, 100, 50};
 
 void setup() {
   // put your setup code here, to run once:
@@ -0,0 +1,440 @@
+/* -----------------------------------------------------------
+ Arduino.cpp  -  host-side stand-in for the Arduino core
+ Released into the public domain.
+
+ The cycle figures below are what the Arduino AVR core (1.8.x, gcc -Os)
+ roughly needs per call on a 16 MHz ATmega328P, including the call
+ overhead. They are estimates taken from disassembly of wiring.c and
+ wiring_digital.c/wiring_analog.c, not exact counts, but good enough
+ to see which HAL calls dominate a library call.
+---------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "Arduino.h"
+#include "avr/eeprom.h"
+
+#define CYCLES_PINMODE		70	// 2 table lookups, cli/sei, read-modify-write
+#define CYCLES_DIGITALWRITE	60	// 3 table lookups, turnOffPWM(), read-modify-write
+#define CYCLES_DIGITALREAD	58	// 3 table lookups, turnOffPWM(), read
+#define CYCLES_ANALOGWRITE	80	// pin->timer lookup, switch, COM bit + OCR write
+#define CYCLES_MILLIS		30	// cli, copy 4 bytes, restore SREG
+#define CYCLES_MICROS		50	// like millis plus TCNT0/overflow handling
+#define CYCLES_DELAYCALL	40	// loop setup; the waiting itself is charged per ms
+#define CYCLES_PER_MS		16000UL
+#define CYCLES_RANDOM		1500	// do_random() uses two 32 bit divisions, random(a,b) a third
+#define CYCLES_EEPROMREAD	30	// wait for EEPE, set EEAR, EERE halts the CPU 4 cycles
+#define CYCLES_EEPROMWRITE	40	// the write itself, the programming runs in the background
+#define EEPROM_WRITE_US		3400	// programming time of one byte, the next access waits for it
+
+HardwareSerial Serial;
+MockHalStats MockStats;
+void (*MockWriteHook)(int pin, int val, unsigned long long us) = 0;
+
+static unsigned long long _now = 0;		// virtual time in microseconds
+static unsigned long _autoadvance = 0;
+static boolean _serialquiet = false;
+static unsigned long _randomstate = 1;
+static int _level[MOCK_NUM_PINS];
+static int (*_source[MOCK_NUM_PINS])(unsigned long long us);
+static int _duty[MOCK_NUM_PINS];
+static int _mode[MOCK_NUM_PINS];
+static volatile uint8_t _portinput[MOCK_NUM_PINS/8 + 2];
+static volatile uint8_t _portoutput[MOCK_NUM_PINS/8 + 2];
+static int _sourcepins[MOCK_NUM_PINS];	// pins that have a source, refreshed when time passes
+static int _nrofsources = 0;
+static void (*_pinchangehook)() = 0;
+static int _serialfd = -1;
+static uint8_t _serialrx[64];		// like the receive buffer of the board
+static int _serialrxhead = 0;
+static int _serialrxtail = 0;
+static uint8_t _eeprom[E2END + 1];
+static boolean _eepromerased = false;
+
+#define PINCHANGE_STEP_US	100	// resolution of the simulated pin change interrupts
+
+static boolean ValidPin(int pin)
+{
+return pin >= 0 && pin < MOCK_NUM_PINS;
+}
+
+static int PinLevel(int pin)
+{
+if (_source[pin])
+  return _source[pin](_now) ? HIGH : LOW;
+return _level[pin];
+}
+
+// keep the port input registers in sync with the pins, returns true if the register changed
+static boolean RefreshPort(int pin)
+{
+uint8_t old = _portinput[pin/8 + 1];
+
+if (PinLevel(pin))
+  _portinput[pin/8 + 1] |= digitalPinToBitMask(pin);
+else
+  _portinput[pin/8 + 1] &= ~digitalPinToBitMask(pin);
+return _portinput[pin/8 + 1] != old;
+}
+
+static void RefreshSources()
+{
+boolean changed = false;
+int i;
+
+for (i=0; i<_nrofsources; i++)
+  changed |= RefreshPort(_sourcepins[i]);
+if (changed && _pinchangehook)
+  _pinchangehook();
+}
+
+// pins with a source can change whenever time passes
+static void AdvanceTime(unsigned long long us)
+{
+unsigned long long step;
+
+if (_nrofsources == 0)
+  {
+  _now += us;
+  return;
+  }
+while (us > 0)
+  {
+  step = (_pinchangehook && us > PINCHANGE_STEP_US) ? PINCHANGE_STEP_US : us;
+  _now += step;
+  us -= step;
+  RefreshSources();
+  }
+}
+
+static void RecordWrite(int pin, int val)
+{
+_duty[pin] = val;
+if (MockWriteHook)
+  MockWriteHook(pin, val, _now);
+}
+
+// ------------ HAL ------------
+
+void pinMode(int pin, int mode)
+{
+MockStats.pinMode++;
+MockStats.avrCycles += CYCLES_PINMODE;
+if (ValidPin(pin))
+  _mode[pin] = mode;
+}
+
+void digitalWrite(int pin, int val)
+{
+MockStats.digitalWrite++;
+MockStats.avrCycles += CYCLES_DIGITALWRITE;
+if (ValidPin(pin))
+  RecordWrite(pin, val ? 255 : 0);
+}
+
+int digitalRead(int pin)
+{
+MockStats.digitalRead++;
+MockStats.avrCycles += CYCLES_DIGITALREAD;
+if (!ValidPin(pin))
+  return LOW;
+return PinLevel(pin);
+}
+
+void analogWrite(int pin, int val)
+{
+MockStats.analogWrite++;
+MockStats.avrCycles += CYCLES_ANALOGWRITE;
+if (ValidPin(pin))
+  RecordWrite(pin, constrain(val, 0, 255));
+}
+
+unsigned long millis()
+{
+MockStats.millis++;
+MockStats.avrCycles += CYCLES_MILLIS;
+AdvanceTime(_autoadvance);
+return (uint32_t)(_now / 1000);	// 32 bit and wrapping like on the board
+}
+
+unsigned long micros()
+{
+MockStats.micros++;
+MockStats.avrCycles += CYCLES_MICROS;
+AdvanceTime(_autoadvance);
+return (uint32_t)_now;
+}
+
+void delay(unsigned long ms)
+{
+MockStats.delay++;
+MockStats.avrCycles += CYCLES_DELAYCALL + ms * CYCLES_PER_MS;
+AdvanceTime((unsigned long long)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+MockStats.delay++;
+MockStats.avrCycles += CYCLES_DELAYCALL + us * (CYCLES_PER_MS / 1000);
+AdvanceTime(us);
+}
+
+// same algorithm as avr-libc random() so sequences match the board
+long random(long howbig)
+{
+long hi, lo, x;
+
+MockStats.random++;
+MockStats.avrCycles += CYCLES_RANDOM;
+if (howbig == 0)
+  return 0;
+x = (long)_randomstate;
+if (x == 0)
+  x = 123459876L;
+hi = x / 127773L;
+lo = x % 127773L;
+x = 16807L * lo - 2836L * hi;
+if (x < 0)
+  x += 0x7fffffffL;
+_randomstate = (unsigned long)x;
+return (long)((unsigned long)x % 0x80000000UL) % howbig;
+}
+
+long random(long howsmall, long howbig)
+{
+if (howsmall >= howbig)
+  return howsmall;
+return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned long seed)
+{
+if (seed != 0)
+  _randomstate = seed;
+}
+
+// ------------ EEPROM (avr/eeprom.h) ------------
+
+static uint8_t * EepromByte(const uint8_t * addr)
+{
+if (!_eepromerased)
+  MockEepromErase();
+return &_eeprom[(uintptr_t)addr & E2END];	// the address wraps like on the chip
+}
+
+uint8_t eeprom_read_byte(const uint8_t * addr)
+{
+MockStats.eepromRead++;
+MockStats.avrCycles += CYCLES_EEPROMREAD;
+return *EepromByte(addr);
+}
+
+void eeprom_write_byte(uint8_t * addr, uint8_t value)
+{
+MockStats.eepromWrite++;
+MockStats.avrCycles += CYCLES_EEPROMWRITE + EEPROM_WRITE_US * (CYCLES_PER_MS / 1000);
+AdvanceTime(EEPROM_WRITE_US);
+*EepromByte(addr) = value;
+}
+
+void eeprom_update_byte(uint8_t * addr, uint8_t value)
+{
+if (eeprom_read_byte(addr) != value)
+  eeprom_write_byte(addr, value);
+}
+
+void MockEepromErase()
+{
+memset(_eeprom, 0xff, sizeof(_eeprom));
+_eepromerased = true;
+}
+
+// ------------ Serial ------------
+
+void HardwareSerial::begin(unsigned long baud)
+{
+(void)baud;
+}
+
+// the fd is read without blocking (see MockSerialAttach) whenever the buffer is empty
+int HardwareSerial::available()
+{
+int n;
+
+if (_serialrxhead == _serialrxtail && _serialfd >= 0)
+  {
+  n = ::read(_serialfd, _serialrx, sizeof(_serialrx));
+  _serialrxhead = 0;
+  _serialrxtail = n > 0 ? n : 0;
+  }
+return _serialrxtail - _serialrxhead;
+}
+
+int HardwareSerial::read()
+{
+if (available() == 0)
+  return -1;
+return _serialrx[_serialrxhead++];
+}
+
+void HardwareSerial::print(const char * str)
+{
+if (!_serialquiet)
+  fputs(str, stdout);
+}
+
+void HardwareSerial::print(char c)
+{
+if (!_serialquiet)
+  putchar(c);
+}
+
+void HardwareSerial::print(int val)
+{
+print((long)val);
+}
+
+void HardwareSerial::print(unsigned int val)
+{
+print((unsigned long)val);
+}
+
+void HardwareSerial::print(long val)
+{
+if (!_serialquiet)
+  printf("%ld", val);
+}
+
+void HardwareSerial::print(unsigned long val)
+{
+if (!_serialquiet)
+  printf("%lu", val);
+}
+
+void HardwareSerial::print(double val)
+{
+if (!_serialquiet)
+  printf("%.2f", val);
+}
+
+void HardwareSerial::println()
+{
+if (!_serialquiet)
+  fputs("\r\n", stdout);
+}
+
+// ------------ Mock control ------------
+
+void MockReset()
+{
+int i;
+
+_now = 0;
+_autoadvance = 0;
+_randomstate = 1;
+for (i=0; i<MOCK_NUM_PINS; i++)
+  {
+  _level[i] = LOW;
+  _source[i] = 0;
+  _duty[i] = 0;
+  _mode[i] = INPUT;
+  }
+_nrofsources = 0;
+_pinchangehook = 0;
+memset((void *)_portoutput, 0, sizeof(_portoutput));
+for (i=0; i<MOCK_NUM_PINS; i++)
+  RefreshPort(i);
+MockResetStats();
+}
+
+void MockResetStats()
+{
+memset(&MockStats, 0, sizeof(MockStats));
+}
+
+unsigned long MockHalCalls()
+{
+return MockStats.pinMode + MockStats.digitalWrite + MockStats.digitalRead +
+       MockStats.analogWrite + MockStats.millis + MockStats.micros +
+       MockStats.delay + MockStats.random + MockStats.eepromRead + MockStats.eepromWrite;
+}
+
+void MockAdvanceMicros(unsigned long us)
+{
+AdvanceTime(us);
+}
+
+unsigned long long MockNowMicros()
+{
+return _now;
+}
+
+void MockSetAutoAdvance(unsigned long usPerCall)
+{
+_autoadvance = usPerCall;
+}
+
+void MockSetSerialQuiet(boolean quiet)
+{
+_serialquiet = quiet;
+}
+
+void MockSerialAttach(int fd)
+{
+if (fd >= 0)
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+_serialfd = fd;
+_serialrxhead = 0;
+_serialrxtail = 0;
+}
+
+void MockSetPin(int pin, int level)
+{
+if (ValidPin(pin))
+  {
+  _level[pin] = level ? HIGH : LOW;
+  MockSetPinSource(pin, 0);
+  }
+}
+
+void MockSetPinSource(int pin, int (*source)(unsigned long long us))
+{
+int i;
+
+if (!ValidPin(pin))
+  return;
+for (i=0; i<_nrofsources; i++)	// forget an old source of this pin
+  if (_sourcepins[i] == pin)
+    _sourcepins[i] = _sourcepins[--_nrofsources];
+_source[pin] = source;
+if (source)
+  _sourcepins[_nrofsources++] = pin;
+if (RefreshPort(pin) && _pinchangehook)
+  _pinchangehook();
+}
+
+void MockSetPinChangeHook(void (*hook)())
+{
+_pinchangehook = hook;
+}
+
+volatile uint8_t * MockPortInputRegister(int port)
+{
+return &_portinput[port];
+}
+
+volatile uint8_t * MockPortOutputRegister(int port)
+{
+return &_portoutput[port];
+}
+
+int MockGetDuty(int pin)
+{
+return ValidPin(pin) ? _duty[pin] : 0;
+}
+
+int MockGetPinMode(int pin)
+{
+return ValidPin(pin) ? _mode[pin] : INPUT;
+}
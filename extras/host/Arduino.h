@@ -0,0 +1,151 @@
+/* -----------------------------------------------------------
+ Arduino.h  -  host-side stand-in for the Arduino core
+ Released into the public domain.
+
+ This file lets pls.cpp be compiled and run on a Linux PC. Only the
+ small part of the Arduino core that the PinLightShield library uses is
+ provided. Time is virtual: it only moves when delay() is called, when
+ MockAdvanceMicros() is called or (if enabled) a little bit on every
+ call to millis()/micros().
+
+ Every HAL call is counted and charged with the number of cycles the
+ real call roughly costs on a 16 MHz ATmega328P, so host tools can
+ estimate the AVR cost of a library call (see Arduino.cpp).
+---------------------------------------------------------------*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define MOCK_NUM_PINS 70	// enough for an Arduino Mega
+#define NUM_DIGITAL_PINS MOCK_NUM_PINS
+#define F_CPU 16000000UL	// the board the cycle estimates are for
+
+// flash memory is ordinary memory on the PC
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr) (*(void * const *)(addr))
+
+template <class T, class L, class H> inline T constrain(T amt, L low, H high)
+{
+return amt < low ? low : (amt > high ? high : amt);
+}
+
+template <class A, class B> inline A min(A a, B b) { return a < b ? a : (A)b; }
+template <class A, class B> inline A max(A a, B b) { return a > b ? a : (A)b; }
+
+// pins are grouped into 8 bit ports like on the board: port 1 holds pins 0..7,
+// port 2 pins 8..15 and so on. The input registers always reflect the pins,
+// the output registers are plain memory (only written by the library itself).
+#define NOT_A_PIN 0
+#define NOT_A_PORT 0
+#define digitalPinToPort(P) ((P) >= 0 && (P) < MOCK_NUM_PINS ? (P)/8 + 1 : NOT_A_PIN)
+#define digitalPinToBitMask(P) ((uint8_t)(1 << ((P) % 8)))
+#define portInputRegister(P) MockPortInputRegister(P)
+#define portOutputRegister(P) MockPortOutputRegister(P)
+
+volatile uint8_t * MockPortInputRegister(int port);
+volatile uint8_t * MockPortOutputRegister(int port);
+
+// ------------ the HAL functions used by the library ------------
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int val);
+int digitalRead(int pin);
+void analogWrite(int pin, int val);
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+#define noInterrupts()		// no interrupts on the PC, see MockSetPinChangeHook
+#define interrupts()
+
+// ------------ Serial (prints to stdout, reads from a file descriptor) ------------
+class Stream
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;		// -1 if nothing is available
+};
+
+class HardwareSerial : public Stream
+{
+  public:
+    void begin(unsigned long baud);
+    int available();
+    int read();
+    void print(const char * str);
+    void print(char c);
+    void print(int val);
+    void print(unsigned int val);
+    void print(long val);
+    void print(unsigned long val);
+    void print(double val);
+    void println();
+    template <class T> void println(T val) { print(val); println(); }
+};
+
+extern HardwareSerial Serial;
+
+// ------------ Mock control interface for host tools ------------
+
+// number of HAL calls and what they would roughly cost on a 16 MHz ATmega328P
+struct MockHalStats
+{
+  unsigned long pinMode;
+  unsigned long digitalWrite;
+  unsigned long digitalRead;
+  unsigned long analogWrite;
+  unsigned long millis;
+  unsigned long micros;
+  unsigned long delay;
+  unsigned long random;
+  unsigned long eepromRead;
+  unsigned long eepromWrite;	// bytes that were programmed (changed)
+  unsigned long long avrCycles;	// estimated AVR cycles of all HAL calls above
+};
+
+extern MockHalStats MockStats;
+
+void MockReset();				// clock to 0, all pins LOW, stats cleared
+void MockResetStats();
+unsigned long MockHalCalls();			// sum of all counters in MockStats
+void MockAdvanceMicros(unsigned long us);	// let virtual time pass
+unsigned long long MockNowMicros();		// 64 bit virtual time (does not wrap)
+void MockSetAutoAdvance(unsigned long usPerCall);	// advance on every millis()/micros() call
+void MockSetSerialQuiet(boolean quiet);		// suppress Serial output
+void MockSerialAttach(int fd);			// Serial reads from fd (e.g. a pseudo terminal), -1 = nothing
+
+// static pin level or a generator that computes the level from virtual time
+void MockSetPin(int pin, int level);
+void MockSetPinSource(int pin, int (*source)(unsigned long long us));
+
+// stands in for pin change interrupts: called whenever an input register changes.
+// While it is set, time advances in steps of 100 us so edges are seen on time.
+void MockSetPinChangeHook(void (*hook)());
+
+int MockGetDuty(int pin);			// last value written with analogWrite/digitalWrite
+int MockGetPinMode(int pin);
+
+// called for every analogWrite/digitalWrite on an output (e.g. to record traces)
+extern void (*MockWriteHook)(int pin, int val, unsigned long long us);
+
+#endif
@@ -0,0 +1,24 @@
+/* -----------------------------------------------------------
+ WS2812_Definitions.h  -  host-side stand-in
+ Released into the public domain.
+
+ ShowLightEffects.ino uses the color names of the SparkFun WS2812
+ Breakout example. This file has the ones the sketch needs (same
+ values), so render.cpp can run the sketch without the original.
+---------------------------------------------------------------*/
+
+#ifndef WS2812_Definitions_h
+#define WS2812_Definitions_h
+
+#define BLACK		0x000000
+#define BROWN		0xA52A2A
+#define CYAN		0x00FFFF
+#define DARKBLUE	0x00008B
+#define DARKRED		0x8B0000
+#define LIME		0x00FF00
+#define NAVY		0x000080
+#define ORANGE		0xFFA500
+#define SEAGREEN	0x2E8B57
+#define TEAL		0x008080
+
+#endif
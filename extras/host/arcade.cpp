@@ -0,0 +1,572 @@
+/* -----------------------------------------------------------
+ arcade.cpp  -  runs the effects of thousands of strips on the PC
+ Released into the public domain.
+
+ Previewing a show for a whole arcade means thousands of RGBStrips. Run
+ one by one (an object per strip, the effect code of pls.cpp) most of the
+ time goes into calls and branches. This engine keeps the state of every
+ effect type as a struct of arrays (all start times in one array, all
+ speeds in the next, ...) and advances all strips of a type with one loop
+ without branches, which the compiler turns into SIMD code.
+
+ The engine has TwoColorFade, TwoColorFlash and MultiColorFlash (with the
+ colors in order, randsequence is not supported) and gives exactly the
+ colors of pls.cpp. The program first checks that: every strip also
+ runs as an RGBStrip (a one-pixel segment of an AddressableStrip) and all
+ colors are compared after every tick. Then it measures strips per second
+ of both ways, one core and several threads:
+
+   g++ -O3 -march=native -pthread -I extras/host -I . pls.cpp \
+       extras/host/Arduino.cpp extras/host/arcade.cpp -o arcade
+   ./arcade [number of strips] [ticks]
+
+ The effects see the time of the tick like they see CurrentMillis; times
+ are 32 bit as on the board. The threads each take a slice of the strips,
+ the strips do not depend on each other.
+---------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include "Arduino.h"
+#include "pls.h"
+
+#define NR_OF_STRIPS	10000
+#define NR_OF_TICKS	2000
+#define CHECK_TICKS	3000
+#define MAX_COLORS	5		// colors of MultiColorFlash
+
+// ------------ the colors of all strips, one plane per color ------------
+struct Frame
+{
+  std::vector<uint8_t> red, green, blue;
+  void Resize(size_t n) { red.assign(n, 0); green.assign(n, 0); blue.assign(n, 0); }
+};
+
+// same as RGBStrip::ScaleColor without gamma
+static inline int32_t Scale(int32_t val, int32_t brightscale)
+{
+val = val < 0 ? 0 : (val > 255 ? 255 : val);
+return (val * brightscale) >> 8;
+}
+
+static int32_t BrightScale(int brightness)	// same as RGBStrip::SetBrightness
+{
+if (brightness < 0 || brightness > 100)
+  brightness = 100;
+return ((unsigned int)brightness * 256 + 50) / 100;
+}
+
+/* ------------ TwoColorFade ------------
+   Every field of RGBStrip::_fx.fade is an array. lo and hi are the limits of
+   a component (the min and max of from and to, times 100) that
+   DetectColorLimit and SwitchDir compute on every step.
+*/
+struct FadeLanes
+{
+  std::vector<uint32_t> start, last, speed, duration;
+  std::vector<int32_t> active, bright;
+  std::vector<int32_t> color[3], dir[3], step[3], lo[3], hi[3];
+  std::vector<uint32_t> strip;		// index of the strip in the Frame
+
+  void Add(uint32_t index, unsigned long from, unsigned long to, int fadestep, unsigned int speed_,
+           unsigned int duration_, int brightness)
+  {
+  int f[3] = {GetRed(from), GetGreen(from), GetBlue(from)};
+  int t[3] = {GetRed(to), GetGreen(to), GetBlue(to)};
+  int diff[3], d, m, i;
+
+  fadestep = constrain(fadestep, 1, 5);
+  for (i=0; i<3; i++)
+    {
+    diff[i] = abs(f[i] - t[i]);
+    dir[i].push_back(f[i] - t[i] < 0 ? +1 : -1);
+    color[i].push_back(f[i] * 100);
+    lo[i].push_back(min(f[i], t[i]) * 100);
+    hi[i].push_back(max(f[i], t[i]) * 100);
+    }
+  // the component that changes most goes 100 * fadestep per step, as in SetupTwoColorFade
+  m = (diff[0] >= diff[1] && diff[0] >= diff[2]) ? 0 : ((diff[1] >= diff[0] && diff[1] >= diff[2]) ? 1 : 2);
+  for (i=0; i<3; i++)
+    {
+    d = (i == m) ? 100 * fadestep : 100 * fadestep * diff[i] / diff[m];
+    step[i].push_back(d);
+    }
+  start.push_back(0);
+  last.push_back(0);
+  speed.push_back(speed_);
+  duration.push_back(duration_);
+  active.push_back(0);
+  bright.push_back(BrightScale(brightness));
+  strip.push_back(index);
+  }
+};
+
+static void FadeTick(FadeLanes & l, size_t from, size_t to, uint32_t now, Frame & out)
+{
+uint32_t * __restrict start = l.start.data(), * __restrict last = l.last.data();
+const uint32_t * __restrict speed = l.speed.data(), * __restrict duration = l.duration.data();
+int32_t * __restrict active = l.active.data();
+const int32_t * __restrict bright = l.bright.data();
+int32_t * __restrict c0 = l.color[0].data(), * __restrict c1 = l.color[1].data(), * __restrict c2 = l.color[2].data();
+int32_t * __restrict d0 = l.dir[0].data(), * __restrict d1 = l.dir[1].data(), * __restrict d2 = l.dir[2].data();
+const int32_t * s0 = l.step[0].data(), * s1 = l.step[1].data(), * s2 = l.step[2].data();
+const int32_t * lo0 = l.lo[0].data(), * lo1 = l.lo[1].data(), * lo2 = l.lo[2].data();
+const int32_t * hi0 = l.hi[0].data(), * hi1 = l.hi[1].data(), * hi2 = l.hi[2].data();
+int32_t r[1024], g[1024], b[1024], run[1024];
+size_t i, n, chunk;
+
+for (; from < to; from += chunk)	// the output is scattered after the loop that vectorizes
+  {
+  chunk = min(to - from, (size_t)1024);
+#pragma GCC ivdep
+  for (n=0; n<chunk; n++)
+    {
+    int32_t first, over, go, lim, x0, x1, x2;
+    i = from + n;
+
+    first = active[i] == 0;
+    start[i] = first ? now : start[i];
+    last[i] = first ? now : last[i];
+    over = !first & (now - start[i] > duration[i]);
+    go = (now - last[i] >= speed[i]) & !over;
+    last[i] = go ? now : last[i];
+    x0 = c0[i] + (go ? d0[i] * s0[i] : 0);
+    x1 = c1[i] + (go ? d1[i] * s1[i] : 0);
+    x2 = c2[i] + (go ? d2[i] * s2[i] : 0);
+    lim = go & (((d0[i] > 0) & (x0 > hi0[i])) | ((d0[i] < 0) & (x0 < lo0[i])) |
+                ((d1[i] > 0) & (x1 > hi1[i])) | ((d1[i] < 0) & (x1 < lo1[i])) |
+                ((d2[i] > 0) & (x2 > hi2[i])) | ((d2[i] < 0) & (x2 < lo2[i])));
+    c0[i] = lim ? (d0[i] > 0 ? hi0[i] : lo0[i]) : x0;	// SwitchDir
+    c1[i] = lim ? (d1[i] > 0 ? hi1[i] : lo1[i]) : x1;
+    c2[i] = lim ? (d2[i] > 0 ? hi2[i] : lo2[i]) : x2;
+    d0[i] = lim ? -d0[i] : d0[i];
+    d1[i] = lim ? -d1[i] : d1[i];
+    d2[i] = lim ? -d2[i] : d2[i];
+    active[i] = !over;
+    run[n] = !over;
+    r[n] = Scale((uint32_t)c0[i] / 100, bright[i]);	// the colors never get negative
+    g[n] = Scale((uint32_t)c1[i] / 100, bright[i]);
+    b[n] = Scale((uint32_t)c2[i] / 100, bright[i]);
+    }
+  for (n=0; n<chunk; n++)
+    if (run[n])		// a finished effect does not write, the strip keeps its color
+      {
+      i = l.strip[from + n];
+      out.red[i] = r[n];
+      out.green[i] = g[n];
+      out.blue[i] = b[n];
+      }
+  }
+}
+
+/* ------------ TwoColorFlash ------------
+   The colors never change, so they are scaled once when the strip is added.
+*/
+struct FlashLanes
+{
+  std::vector<uint32_t> start, last, duration, duration1, duration2;
+  std::vector<int32_t> active, color1active;
+  std::vector<int32_t> red1, green1, blue1, red2, green2, blue2;
+  std::vector<uint32_t> strip;
+
+  void Add(uint32_t index, const int color1[3], const int color2[3], unsigned int col1duration,
+           unsigned int col2duration, unsigned int duration_, int brightness)
+  {
+  int32_t bs = BrightScale(brightness);
+
+  red1.push_back(Scale(color1[0], bs));
+  green1.push_back(Scale(color1[1], bs));
+  blue1.push_back(Scale(color1[2], bs));
+  red2.push_back(Scale(color2[0], bs));
+  green2.push_back(Scale(color2[1], bs));
+  blue2.push_back(Scale(color2[2], bs));
+  duration1.push_back(col1duration);
+  duration2.push_back(col2duration);
+  duration.push_back(duration_);
+  start.push_back(0);
+  last.push_back(0);
+  active.push_back(0);
+  color1active.push_back(1);
+  strip.push_back(index);
+  }
+};
+
+static void FlashTick(FlashLanes & l, size_t from, size_t to, uint32_t now, Frame & out)
+{
+uint32_t * __restrict start = l.start.data(), * __restrict last = l.last.data();
+const uint32_t * __restrict duration = l.duration.data();
+const uint32_t * __restrict du1 = l.duration1.data(), * __restrict du2 = l.duration2.data();
+int32_t * __restrict active = l.active.data(), * __restrict c1 = l.color1active.data();
+const int32_t * r1 = l.red1.data(), * g1 = l.green1.data(), * b1 = l.blue1.data();
+const int32_t * r2 = l.red2.data(), * g2 = l.green2.data(), * b2 = l.blue2.data();
+int32_t r[1024], g[1024], b[1024], run[1024];
+size_t i, n, chunk;
+
+for (; from < to; from += chunk)
+  {
+  chunk = min(to - from, (size_t)1024);
+#pragma GCC ivdep
+  for (n=0; n<chunk; n++)
+    {
+    int32_t first, over, sw;
+    i = from + n;
+
+    first = active[i] == 0;
+    start[i] = first ? now : start[i];
+    last[i] = first ? now : last[i];
+    over = !first & (now - start[i] > duration[i]);
+    sw = !over & (now - last[i] >= (c1[i] ? du1[i] : du2[i]));
+    last[i] = sw ? now : last[i];
+    c1[i] ^= sw;
+    active[i] = !over;
+    run[n] = !over;
+    r[n] = c1[i] ? r1[i] : r2[i];
+    g[n] = c1[i] ? g1[i] : g2[i];
+    b[n] = c1[i] ? b1[i] : b2[i];
+    }
+  for (n=0; n<chunk; n++)
+    if (run[n])
+      {
+      i = l.strip[from + n];
+      out.red[i] = r[n];
+      out.green[i] = g[n];
+      out.blue[i] = b[n];
+      }
+  }
+}
+
+/* ------------ MultiColorFlash ------------
+   The color and the duration of the active index are picked with a compare
+   per possible index instead of an indexed load.
+*/
+struct MultiLanes
+{
+  std::vector<uint32_t> start, last, duration;
+  std::vector<int32_t> active, index, nrofcolors;
+  std::vector<uint32_t> durations[MAX_COLORS];
+  std::vector<int32_t> red[MAX_COLORS], green[MAX_COLORS], blue[MAX_COLORS];
+  std::vector<uint32_t> strip;
+
+  void Add(uint32_t index_, byte n, const unsigned long colors[MAX_COLORS], const unsigned int durations_[MAX_COLORS],
+           unsigned int duration_, int brightness)
+  {
+  int32_t bs = BrightScale(brightness);
+  int k;
+
+  for (k=0; k<MAX_COLORS; k++)
+    {
+    red[k].push_back(Scale(GetRed(colors[k]), bs));
+    green[k].push_back(Scale(GetGreen(colors[k]), bs));
+    blue[k].push_back(Scale(GetBlue(colors[k]), bs));
+    durations[k].push_back(durations_[k]);
+    }
+  nrofcolors.push_back(min(n, (byte)MAX_COLORS));
+  duration.push_back(duration_);
+  start.push_back(0);
+  last.push_back(0);
+  active.push_back(0);
+  index.push_back(0);
+  strip.push_back(index_);
+  }
+};
+
+static void MultiTick(MultiLanes & l, size_t from, size_t to, uint32_t now, Frame & out)
+{
+uint32_t * __restrict start = l.start.data(), * __restrict last = l.last.data();
+const uint32_t * __restrict duration = l.duration.data();
+int32_t * __restrict active = l.active.data(), * __restrict index = l.index.data();
+const int32_t * __restrict nrofcolors = l.nrofcolors.data();
+const uint32_t * dur[MAX_COLORS];
+const int32_t * red[MAX_COLORS], * green[MAX_COLORS], * blue[MAX_COLORS];
+int32_t r[1024], g[1024], b[1024], run[1024];
+size_t i, n, chunk;
+int k;
+
+for (k=0; k<MAX_COLORS; k++)
+  {
+  dur[k] = l.durations[k].data();
+  red[k] = l.red[k].data();
+  green[k] = l.green[k].data();
+  blue[k] = l.blue[k].data();
+  }
+for (; from < to; from += chunk)
+  {
+  chunk = min(to - from, (size_t)1024);
+#pragma GCC ivdep
+  for (n=0; n<chunk; n++)
+    {
+    int32_t first, over, sw, next, x;
+    uint32_t d = 0;
+    i = from + n;
+
+    first = active[i] == 0;
+    start[i] = first ? now : start[i];
+    last[i] = first ? now : last[i];
+    over = !first & (now - start[i] > duration[i]);
+    x = index[i];
+#pragma GCC unroll 5
+    for (k=0; k<MAX_COLORS; k++)
+      d = (x == k) ? dur[k][i] : d;
+    sw = !over & (now - last[i] >= d);
+    last[i] = sw ? now : last[i];
+    next = x + 1 > nrofcolors[i] - 1 ? 0 : x + 1;
+    x = sw ? next : x;
+    index[i] = x;
+    active[i] = !over;
+    run[n] = !over;
+    r[n] = g[n] = b[n] = 0;
+#pragma GCC unroll 5
+    for (k=0; k<MAX_COLORS; k++)
+      {
+      r[n] = (x == k) ? red[k][i] : r[n];
+      g[n] = (x == k) ? green[k][i] : g[n];
+      b[n] = (x == k) ? blue[k][i] : b[n];
+      }
+    }
+  for (n=0; n<chunk; n++)
+    if (run[n])
+      {
+      i = l.strip[from + n];
+      out.red[i] = r[n];
+      out.green[i] = g[n];
+      out.blue[i] = b[n];
+      }
+  }
+}
+
+// ------------ the engine: all strips of the arcade ------------
+struct Arcade
+{
+  FadeLanes fade;
+  FlashLanes flash;
+  MultiLanes multi;
+  Frame frame;
+
+  // advances the lanes [part / parts] of every effect type, so threads can share the work
+  void Tick(uint32_t now, unsigned part = 0, unsigned parts = 1)
+  {
+  FadeTick(fade, fade.start.size() * part / parts, fade.start.size() * (part + 1) / parts, now, frame);
+  FlashTick(flash, flash.start.size() * part / parts, flash.start.size() * (part + 1) / parts, now, frame);
+  MultiTick(multi, multi.start.size() * part / parts, multi.start.size() * (part + 1) / parts, now, frame);
+  }
+};
+
+// ------------ the same strips as RGBStrip objects ------------
+struct Reference
+{
+  std::vector<RGBStrip *> strips;
+  std::vector<byte> effect;
+  std::vector<boolean> active;
+
+  void Tick(unsigned long now, size_t from, size_t to)
+  {
+  size_t i;
+
+  for (i=from; i<to; i++)
+    {
+    boolean a = active[i];
+
+    switch (effect[i])
+      {
+      case PLS_EFFECT_TWOCOLORFADE:
+        strips[i]->TwoColorFade(now, &a);
+        break;
+      case PLS_EFFECT_TWOCOLORFLASH:
+        strips[i]->TwoColorFlash(now, &a);
+        break;
+      case PLS_EFFECT_MULTICOLORFLASH:
+        strips[i]->MultiColorFlash(now, &a);
+        break;
+      }
+    active[i] = a;
+    }
+  }
+};
+
+static unsigned long RandomColor()
+{
+return ((unsigned long)(rand() & 0xff) << 16) | ((rand() & 0xff) << 8) | (rand() & 0xff);
+}
+
+// ------------ Function to set up n random strips both ways ------------
+static void Build(size_t n, Arcade & arcade, Reference & ref, AddressableStrip * pixels)
+{
+unsigned long from, to, colors[MAX_COLORS];
+int color1[3], color2[3];
+unsigned int durations[MAX_COLORS];
+int brightness, k;
+size_t i;
+RGBStrip * strip;
+
+arcade.frame.Resize(n);
+for (i=0; i<n; i++)
+  {
+  brightness = (rand() % 4) ? 100 : 10 + rand() % 90;
+  strip = pixels ? new RGBStrip(pixels, i, 1, brightness) : 0;
+  switch (rand() % 3)
+    {
+    case 0:
+      do		// from and to must differ, else SetupTwoColorFade divides by 0
+        {
+        from = RandomColor();
+        to = RandomColor();
+        }
+      while (from == to);
+      {
+      int fadestep = 1 + rand() % 5;
+      unsigned int speed = 1 + rand() % 20, duration = 500 + rand() % 60000;
+
+      arcade.fade.Add(i, from, to, fadestep, speed, duration, brightness);
+      if (strip)
+        strip->SetupTwoColorFade(from, to, fadestep, speed, duration);
+      ref.effect.push_back(PLS_EFFECT_TWOCOLORFADE);
+      }
+      break;
+    case 1:
+      for (k=0; k<3; k++)
+        {
+        color1[k] = rand() % 300 - 20;	// out of range values are clipped by both
+        color2[k] = rand() % 256;
+        }
+      {
+      unsigned int d1 = 10 + rand() % 300, d2 = 10 + rand() % 300, duration = 500 + rand() % 60000;
+
+      arcade.flash.Add(i, color1, color2, d1, d2, duration, brightness);
+      if (strip)
+        strip->SetupTwoColorFlash(color1, color2, d1, d2, duration);
+      ref.effect.push_back(PLS_EFFECT_TWOCOLORFLASH);
+      }
+      break;
+    default:
+      for (k=0; k<MAX_COLORS; k++)
+        {
+        colors[k] = RandomColor();
+        durations[k] = 10 + rand() % 300;
+        }
+      {
+      byte nrofcolors = 1 + rand() % MAX_COLORS;
+      unsigned int duration = 500 + rand() % 60000;
+
+      arcade.multi.Add(i, nrofcolors, colors, durations, duration, brightness);
+      if (strip)
+        strip->SetupMultiColorFlash(nrofcolors, colors, durations, false, duration);
+      ref.effect.push_back(PLS_EFFECT_MULTICOLORFLASH);
+      }
+      break;
+    }
+  ref.strips.push_back(strip);
+  ref.active.push_back(false);
+  }
+}
+
+// ------------ check: the engine must give the colors of pls.cpp ------------
+static int Check(size_t n)
+{
+std::vector<byte> buffer(n * 3);
+AddressableStrip pixels(8, buffer.data(), n);
+Arcade arcade;
+Reference ref;
+unsigned long now = 1000, color, diffs = 0;
+size_t i;
+int tick;
+
+srand(1);
+Build(n, arcade, ref, &pixels);
+for (tick=0; tick<CHECK_TICKS; tick++)
+  {
+  now += rand() % 40;		// loop() passes of 0 .. 39 ms
+  arcade.Tick(now);
+  ref.Tick(now, 0, n);
+  for (i=0; i<n; i++)
+    {
+    color = pixels.GetPixel(i);
+    if (GetRed(color) != arcade.frame.red[i] || GetGreen(color) != arcade.frame.green[i] ||
+        GetBlue(color) != arcade.frame.blue[i])
+      {
+      if (!diffs)
+        printf("first difference: tick %d strip %zu effect %d: pls.cpp %06lx, engine %02x%02x%02x\n",
+               tick, i, ref.effect[i], color, arcade.frame.red[i], arcade.frame.green[i], arcade.frame.blue[i]);
+      diffs++;
+      }
+    }
+  }
+printf("check: %zu strips (%zu fades, %zu two color flashes, %zu multi color flashes), %d ticks: %s\n",
+       n, arcade.fade.start.size(), arcade.flash.start.size(), arcade.multi.start.size(), CHECK_TICKS,
+       diffs ? "DIFFERENT" : "same colors");
+return diffs ? 1 : 0;
+}
+
+// ------------ benchmark: strips per second ------------
+static double Seconds(std::chrono::steady_clock::time_point start)
+{
+return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void Benchmark(size_t n, int ticks)
+{
+std::vector<byte> buffer(n * 3);
+AddressableStrip pixels(8, buffer.data(), n);
+std::chrono::steady_clock::time_point start;
+std::vector<std::thread> threads;
+Arcade arcade;
+Reference ref;
+unsigned hw, nrofthreads, t;
+double s, single = 0;
+int tick;
+
+srand(2);
+Build(n, arcade, ref, &pixels);
+start = std::chrono::steady_clock::now();
+for (tick=0; tick<ticks; tick++)
+  ref.Tick(1000 + tick * 10, 0, n);
+s = Seconds(start);
+printf("\n%zu strips, %d ticks of 10 ms\n", n, ticks);
+printf("%-34s %8.1f M strips/s\n", "RGBStrip objects (pls.cpp)", n * ticks / s / 1e6);
+
+start = std::chrono::steady_clock::now();
+for (tick=0; tick<ticks; tick++)
+  arcade.Tick(1000 + tick * 10);
+single = n * ticks / Seconds(start);
+printf("%-34s %8.1f M strips/s\n", "engine, 1 thread", single / 1e6);
+
+// every thread runs all ticks on its slice of the lanes
+hw = std::thread::hardware_concurrency();
+for (nrofthreads=2; nrofthreads<=max(hw, 2u); nrofthreads*=2)
+  {
+  char name[40];
+
+  start = std::chrono::steady_clock::now();
+  for (t=0; t<nrofthreads; t++)
+    threads.emplace_back([&arcade, t, nrofthreads, ticks]() {
+      for (int k=0; k<ticks; k++)
+        arcade.Tick(1000 + k * 10, t, nrofthreads);
+      });
+  for (std::thread & th : threads)
+    th.join();
+  threads.clear();
+  s = n * ticks / Seconds(start);
+  snprintf(name, sizeof(name), "engine, %u threads", nrofthreads);
+  printf("%-34s %8.1f M strips/s (%.1fx)\n", name, s / 1e6, s / single);
+  }
+}
+
+int main(int argc, char * argv[])
+{
+size_t n = argc > 1 ? atol(argv[1]) : NR_OF_STRIPS;
+int ticks = argc > 2 ? atoi(argv[2]) : NR_OF_TICKS;
+
+if (n == 0 || ticks <= 0)
+  {
+  fprintf(stderr, "usage: %s [number of strips] [ticks]\n", argv[0]);
+  return 2;
+  }
+MockReset();
+if (Check(min(n, (size_t)2000)))
+  return 1;
+Benchmark(n, ticks);
+return 0;
+}
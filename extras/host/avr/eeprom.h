@@ -0,0 +1,24 @@
+/* -----------------------------------------------------------
+ avr/eeprom.h  -  host-side stand-in for the EEPROM functions of avr-libc
+ Released into the public domain.
+
+ The EEPROM is an array that keeps its content over MockReset(), like the
+ chip keeps it over a reset of the board; it starts erased (all 0xFF).
+ Reads and writes are counted in MockStats. A write that changes a byte
+ lets the virtual time pass that the chip needs to program it.
+---------------------------------------------------------------*/
+
+#ifndef eeprom_h
+#define eeprom_h
+
+#include <stdint.h>
+
+#define E2END	4095		// 4 KB like the ATmega2560 (the ATmega328P has 1 KB)
+
+uint8_t eeprom_read_byte(const uint8_t * addr);
+void eeprom_write_byte(uint8_t * addr, uint8_t value);
+void eeprom_update_byte(uint8_t * addr, uint8_t value);	// writes only if the byte changes
+
+void MockEepromErase();		// all bytes 0xFF, like a new chip
+
+#endif
@@ -0,0 +1,698 @@
+/* -----------------------------------------------------------
+ bench.cpp  -  loop budget benchmark for the PinLightShield library
+ Released into the public domain.
+
+ Runs every public method of pls.cpp against the host-side Arduino
+ stand-in and reports what one call costs. Build and run it from the
+ library folder on a Linux PC:
+
+   g++ -O2 -I extras/host -I . pls.cpp extras/host/Arduino.cpp \
+       extras/host/bench.cpp -o plsbench
+   ./plsbench [filter]
+
+ Columns:
+   ns/call     wall time of one call on the host
+   HAL/call    Arduino core calls (analogWrite, digitalRead, ...) per call
+   HALcyc      AVR cycles of those core calls (figures from Arduino.cpp)
+   AVRcyc      estimated AVR cycles per call: HALcyc plus the remaining
+               host time scaled by a calibration kernel with a known AVR
+               cost. This is a coarse estimate, use it to compare methods
+               and versions of the library, not as an exact count.
+   +-          error of AVRcyc from the spread of the timings and of the
+               calibration. It does not include the error of the model:
+               code that is very different from the kernel (long divisions,
+               float, big loops over bytes) is off by more than that.
+   us@16MHz    AVRcyc converted to microseconds on a 16 MHz board
+---------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <functional>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "Arduino.h"
+#include "pls.h"
+
+#define BENCH_ITERATIONS	200000UL
+#define AVR_MHZ			16.0
+
+// The calibration kernel is a chain of calls of a small function that works on
+// the fields of a struct like the methods of pls.cpp do (load, add, compare,
+// store 16 bit values); every call needs the result of the one before. On the
+// AVR one call costs about 32 cycles: call/ret 8, passing the arguments and the
+// result 4, 2 ldd pairs 8, add/cp/sub pairs 5, std pair 4, branch 2 and the
+// loop counter (4 cycles every 8 calls). One pass takes several us on the
+// host, so the resolution of the clock does not matter.
+#define CALIBRATION_CALLS	4096
+#define CALIBRATION_PASSES	301	// the median pass is used
+#define CALIBRATION_AVR_CYCLES	(CALIBRATION_CALLS * 32.0)
+
+static double _cyclesPerHostNs;		// AVR cycles per ns of host time
+static double _cyclesError;		// relative error of _cyclesPerHostNs (half the quartile range)
+static double _halHostNs;		// host time of one mocked HAL call
+static const char * _filter = 0;
+
+#define BENCH_ROUNDS		5	// the median round is used, the others give the error
+
+// RAM budget of an RGBStrip on the host (int 4, long 8 bytes; about 70 bytes on
+// the AVR). Only the state of one effect may be kept at a time, see RGBStrip::UseEffect.
+#define RGBSTRIP_HOST_BUDGET	176
+static_assert(sizeof(RGBStrip) <= RGBSTRIP_HOST_BUDGET, "RGBStrip got bigger than its RAM budget");
+
+static int CompareDouble(const void * a, const void * b)
+{
+double x = *(const double *)a, y = *(const double *)b;
+return (x > y) - (x < y);
+}
+
+// host time of one call of fn, spread (if given) is half the range of the
+// middle rounds, a round that was interrupted by the OS does not count
+static double HostNs(std::function<void()> fn, unsigned long iterations, double * spread = 0)
+{
+std::chrono::steady_clock::time_point start;
+double ns[BENCH_ROUNDS];
+unsigned long i;
+int round;
+
+for (round=0; round<BENCH_ROUNDS; round++)
+  {
+  start = std::chrono::steady_clock::now();
+  for (i=0; i<iterations; i++)
+    fn();
+  ns[round] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+  }
+qsort(ns, BENCH_ROUNDS, sizeof(double), CompareDouble);
+if (spread)
+  *spread = (ns[BENCH_ROUNDS * 3 / 4] - ns[BENCH_ROUNDS / 4]) / 2;
+return ns[BENCH_ROUNDS / 2];
+}
+
+// ------------ calibrate host time against AVR cycles ----------------
+struct CalibrationState
+{
+  uint16_t step;
+  uint16_t limit;
+  uint16_t last;
+};
+
+static uint16_t __attribute__((noinline, noclone)) CalibrationStep(CalibrationState * state, uint16_t x)
+{
+x += state->step;
+if (x >= state->limit)
+  x -= state->limit;
+state->last = x;
+return x;
+}
+
+static uint16_t __attribute__((noinline)) CalibrationKernel(CalibrationState * state, uint16_t x)
+{
+int i;
+
+for (i=0; i<CALIBRATION_CALLS / 8; i++)
+  {
+  x = CalibrationStep(state, x); x = CalibrationStep(state, x);
+  x = CalibrationStep(state, x); x = CalibrationStep(state, x);
+  x = CalibrationStep(state, x); x = CalibrationStep(state, x);
+  x = CalibrationStep(state, x); x = CalibrationStep(state, x);
+  }
+return x;
+}
+
+// Every pass is timed on its own and the passes are sorted, so a pass that was
+// interrupted by the OS only moves the upper quartile, not the median.
+// With the TSC of an x86 PC the result is checked against the host clock: one
+// call of the chain takes 3..40 host cycles on any PC (call, ret and the
+// dependent add/compare), outside of that the timing is wrong and the AVRcyc
+// column must not be trusted.
+static void Calibrate()
+{
+static double passns[CALIBRATION_PASSES];
+static volatile uint16_t seed = 1;
+CalibrationState state = {0x5555, 0xaaab, 0};
+uint16_t x = seed;
+std::chrono::steady_clock::time_point start;
+double median, lower, upper, emptyns;
+int i;
+
+x = CalibrationKernel(&state, x);	// warm up
+for (i=0; i<CALIBRATION_PASSES; i++)
+  {
+  start = std::chrono::steady_clock::now();
+  x = CalibrationKernel(&state, x);
+  passns[i] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  }
+qsort(passns, CALIBRATION_PASSES, sizeof(double), CompareDouble);
+median = passns[CALIBRATION_PASSES / 2];
+lower = passns[CALIBRATION_PASSES / 4];
+upper = passns[CALIBRATION_PASSES * 3 / 4];
+_cyclesPerHostNs = CALIBRATION_AVR_CYCLES / median;
+_cyclesError = (upper - lower) / 2 / median;
+printf("calibration: %.2f AVR cycles per host ns +-%.1f%% (median of %d passes of %d dependent calls, %.0f ns each)\n",
+       _cyclesPerHostNs, _cyclesError * 100, CALIBRATION_PASSES, CALIBRATION_CALLS, median);
+
+#if defined(__x86_64__) || defined(__i386__)
+unsigned long long tsc;
+double hostcycles;
+
+tsc = __rdtsc();
+x = CalibrationKernel(&state, x);
+hostcycles = (double)(__rdtsc() - tsc) / CALIBRATION_CALLS;
+printf("             %.1f host (TSC) cycles per call", hostcycles);
+if (hostcycles < 3 || hostcycles > 40)
+  printf(", NOT PLAUSIBLE: the AVRcyc column is wrong on this PC");
+printf("\n");
+#endif
+
+emptyns = HostNs([]() {}, BENCH_ITERATIONS * 10);
+_halHostNs = HostNs([]() { analogWrite(5, 128); }, BENCH_ITERATIONS * 10) - emptyns;
+printf("             %.1f ns per mocked HAL call\n", _halHostNs);
+seed = x;
+}
+
+// ------------ run one benchmark case ----------------
+// setup() runs once on a freshly reset board, call() once per simulated
+// loop() pass; virtual time advances by stepus before every pass.
+// Returns AVRcyc, its error is stored in avrerror (if given).
+static double Bench(const char * method, const char * params, unsigned long stepus,
+                    std::function<void()> setup, std::function<void(unsigned long)> call,
+                    double * avrerror = 0)
+{
+unsigned long halcalls;
+unsigned long long cycles;
+double ns, overheadns, halpercall, halcyc, avrcyc, computens, nsspread, overheadspread, error;
+std::function<void(unsigned long)> empty = [](unsigned long now) { (void)now; };
+
+if (_filter && !strstr(method, _filter))
+  return 0;
+
+MockReset();
+MockSetSerialQuiet(true);
+setup();
+
+// the same loop with an empty call: time passing (incl. input signals) is not part of the method
+overheadns = HostNs([&]() {
+  MockAdvanceMicros(stepus);
+  empty((unsigned long)(uint32_t)(MockNowMicros() / 1000));
+  }, BENCH_ITERATIONS, &overheadspread);
+MockResetStats();
+
+ns = HostNs([&]() {
+  MockAdvanceMicros(stepus);
+  call((unsigned long)(uint32_t)(MockNowMicros() / 1000));
+  }, BENCH_ITERATIONS, &nsspread);
+
+halcalls = MockHalCalls();
+cycles = MockStats.avrCycles;
+halpercall = (double)halcalls / (BENCH_ITERATIONS * BENCH_ROUNDS);
+halcyc = (double)cycles / (BENCH_ITERATIONS * BENCH_ROUNDS);
+computens = ns - overheadns - halpercall * _halHostNs;
+if (computens < 0)
+  computens = 0;
+avrcyc = halcyc + computens * _cyclesPerHostNs;
+// the errors of the two timings and of the calibration are independent
+error = _cyclesPerHostNs * sqrt(nsspread * nsspread + overheadspread * overheadspread +
+                                computens * computens * _cyclesError * _cyclesError);
+
+printf("%-32s %-28s %9.1f %9.2f %10.0f %10.0f %7.0f %10.1f\n",
+       method, params, ns, halpercall, halcyc, avrcyc, error, avrcyc / AVR_MHZ);
+if (avrerror)
+  *avrerror = error;
+return avrcyc;
+}
+
+// ------------ input signals for the switch/insert benchmarks ----------------
+
+static int BallRollingThrough(unsigned long long us)	// 40 ms closed every 250 ms
+{
+return (us / 1000) % 250 < 40;
+}
+
+static int LampMatrixOn(unsigned long long us)		// 2 ms strobe every 16 ms
+{
+return (us / 1000) % 16 < 2;
+}
+
+static int LampMatrixBlinking(unsigned long long us)	// strobed, 250 ms on / 250 ms off
+{
+return ((us / 1000) % 500 < 250) && LampMatrixOn(us);
+}
+
+// ------------ rule set for the RuleEngine benchmark: 16 switches, 4 outputs ----------------
+static const byte _ruleinputs[16] PROGMEM = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+static const byte _ruleconditions[16] PROGMEM = {
+  PLS_RULE_PRESSED, PLS_RULE_WHILE_PRESSED, PLS_RULE_PRESSED, PLS_RULE_WHILE_PRESSED,
+  PLS_RULE_PRESSED, PLS_RULE_WHILE_PRESSED, PLS_RULE_PRESSED, PLS_RULE_WHILE_PRESSED,
+  PLS_RULE_PRESSED, PLS_RULE_WHILE_PRESSED, PLS_RULE_PRESSED, PLS_RULE_WHILE_PRESSED,
+  PLS_RULE_PRESSED, PLS_RULE_WHILE_PRESSED, PLS_RULE_PRESSED, PLS_RULE_WHILE_PRESSED};
+static const byte _ruleslots[16] PROGMEM = {0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3};
+static const byte _ruleeffects[16] PROGMEM = {
+  PLS_EFFECT_PULSE, PLS_EFFECT_FLASHES, PLS_EFFECT_PULSE, PLS_EFFECT_FLASHES,
+  PLS_EFFECT_PULSE, PLS_EFFECT_FLASHES, PLS_EFFECT_PULSE, PLS_EFFECT_FLASHES,
+  PLS_EFFECT_PULSE, PLS_EFFECT_FLASHES, PLS_EFFECT_PULSE, PLS_EFFECT_FLASHES,
+  PLS_EFFECT_PULSE, PLS_EFFECT_FLASHES, PLS_EFFECT_PULSE, PLS_EFFECT_FLASHES};
+static const unsigned long _rulecolors[16] PROGMEM = {
+  0, 200, 0, 200, 0, 200, 0, 200, 0, 200, 0, 200, 0, 200, 0, 200};
+static const int _ruleparams1[16] PROGMEM = {
+  255, 3, 255, 3, 255, 3, 255, 3, 255, 3, 255, 3, 255, 3, 255, 3};
+static const int _ruleparams2[16] PROGMEM = {
+  0, 50, 0, 50, 0, 50, 0, 50, 0, 50, 0, 50, 0, 50, 0, 50};
+static const unsigned int _ruledurations[16] PROGMEM = {
+  100, 0, 100, 0, 100, 0, 100, 0, 100, 0, 100, 0, 100, 0, 100, 0};
+static const PlsRuleSet _benchrules = {16, _ruleinputs, _ruleconditions, _ruleslots, _ruleeffects,
+  _rulecolors, 0, _ruleparams1, _ruleparams2, _ruledurations};
+
+static void PinChangeInterrupt()
+{
+InsertCapture::HandleInterrupt();
+}
+
+// a show that never ends: fades, flashes and a rainbow
+static const byte benchshow[] PROGMEM = {
+  PLS_SHOW_LOOP(0),
+    PLS_SHOW_FADE(255, 0, 0, 500),
+    PLS_SHOW_FLASH(255, 255, 0, 3, 50),
+    PLS_SHOW_FADE(0, 0, 255, 500),
+    PLS_SHOW_RAINBOW(1560, 1000),
+  PLS_SHOW_NEXT()
+};
+
+// the colors of MultiColorFlash as a palette, blended instead of cut
+static const PlsKeyframe benchpalette[] PROGMEM = {
+  {0x00, 0x00, 0x80, PLS_KEY_LINEAR, 200},
+  {0x00, 0xff, 0x00, PLS_KEY_EASE, 100},
+  {0x8b, 0x00, 0x00, PLS_KEY_LINEAR, 200},
+  {0xff, 0xa5, 0x00, PLS_KEY_HARDCUT, 100},
+  {0x00, 0xff, 0xff, PLS_KEY_LINEAR, 50}
+};
+
+// serves the same 6 strip frame over and over, one frame per Poll()
+class FrameStream : public Stream
+{
+  public:
+    byte frame[21];
+    int pos;
+    int left;
+    int available() { return left; }
+    int read() { if (left == 0) return -1; left--; pos %= sizeof(frame); return frame[pos++]; }
+};
+
+int main(int argc, char * argv[])
+{
+static unsigned long multicolors[5] = {0x000080, 0x00ff00, 0x8b0000, 0xffa500, 0x00ffff};
+static unsigned int multidurations[5] = {200, 100, 200, 100, 50};
+static int blue[3] = {0, 0, 255};
+static int yellow[3] = {250, 250, 0};
+static RGBStrip * strip;
+static Std12VOutput * output;
+static Switch * sw;
+static OptoSwitch * opto;
+static Insert * insert;
+static StdInput * input;
+static boolean active;
+int i;
+char params[64];
+
+if (argc > 1)
+  _filter = argv[1];
+
+Calibrate();
+printf("\n");
+printf("%-32s %-28s %9s %9s %10s %10s %7s %10s\n",
+       "method", "params", "ns/call", "HAL/call", "HALcyc", "AVRcyc", "+-", "us@16MHz");
+
+MockReset();
+MockSetSerialQuiet(true);
+strip = new RGBStrip(5, 6, 3);
+output = new Std12VOutput(9);
+sw = new Switch(14, 100);
+opto = new OptoSwitch(15, 100);
+insert = new Insert(16, 20, 600, 600);
+input = new StdInput(17);
+
+// ------------ RGBStrip ----------------
+for (i=100; i>=50; i-=50)
+  {
+  snprintf(params, sizeof(params), "brightness=%d", i);
+  Bench("RGBStrip::LightStrip(ulong)", params, 200,
+        [&]() { strip->SetBrightness(i); },
+        [&](unsigned long now) { strip->LightStrip((unsigned long)(now & 0xffffff)); });
+  Bench("RGBStrip::LightStrip(r,g,b)", params, 200,
+        [&]() { strip->SetBrightness(i); },
+        [&](unsigned long now) { strip->LightStrip(now & 0xff, 128, 255); });
+  Bench("RGBStrip::LightStrip(int[3])", params, 200,
+        [&]() { strip->SetBrightness(i); },
+        [&](unsigned long now) { (void)now; strip->LightStrip(yellow); });
+  }
+Bench("RGBStrip::LightStrip(r,g,b)", "brightness=50 gamma", 200,
+      [&]() { strip->SetBrightness(50); strip->SetGamma(true); },
+      [&](unsigned long now) { strip->LightStrip(now & 0xff, 128, 255); });
+strip->SetGamma(false);
+Bench("RGBStrip::LightStripHSV", "brightness=100", 200,
+      [&]() { strip->SetBrightness(100); },
+      [&](unsigned long now) { strip->LightStripHSV(now & 0xff, 255, 255); });
+static byte hsvcolors[60 * 3], rgbcolors[60 * 3];
+for (i=0; i<60; i++)
+  {
+  hsvcolors[i * 3] = i * 4;
+  hsvcolors[i * 3 + 1] = 200;
+  hsvcolors[i * 3 + 2] = 255;
+  }
+Bench("HSV2RGB", "one color", 200,
+      [&]() {},
+      [&](unsigned long now) { HSV2RGB(now & 0xff, 200, 255, &rgbcolors[0], &rgbcolors[1], &rgbcolors[2]); });
+Bench("HSV2RGB", "batch of 60 colors", 200,
+      [&]() {},
+      [&](unsigned long now) { hsvcolors[0] = now; HSV2RGB(hsvcolors, rgbcolors, 60); });
+Bench("RGBStrip::SwitchOff", "", 200,
+      [&]() { strip->SetBrightness(100); },
+      [&](unsigned long now) { (void)now; strip->SwitchOff(); });
+Bench("RGBStrip::SetBrightness", "", 200,
+      [&]() {},
+      [&](unsigned long now) { strip->SetBrightness(now % 101); });
+Bench("RGBStrip::MakeFlashes", "flashes=3 length=50", 0,
+      [&]() {},
+      [&](unsigned long now) { (void)now; strip->MakeFlashes(0xffffff, 3, 50); });
+
+Bench("RGBStrip::Flashes", "flashes=3 length=50", 200,
+      [&]() { strip->SetupFlashes(0xffffff, 3, 50); active = false; },
+      [&](unsigned long now) { strip->Flashes(now, &active); });
+
+static const int rainbowspeeds[] = {1, 7, 50};
+static const unsigned long loopsteps[] = {100, 1000};
+for (int speed : rainbowspeeds)
+  for (unsigned long step : loopsteps)
+    {
+    snprintf(params, sizeof(params), "speed=%d loop=%luus", speed, step);
+    Bench("RGBStrip::RainbowColorChange", params, step,
+          [&]() { strip->SetRainbowSpeed(speed); },
+          [&](unsigned long now) { strip->RainbowColorChange(now); });
+    }
+
+static const byte nrofcolors[] = {2, 5};
+for (byte n : nrofcolors)
+  for (int rnd=0; rnd<=1; rnd++)
+    {
+    snprintf(params, sizeof(params), "colors=%d random=%d", n, rnd);
+    Bench("RGBStrip::MultiColorFlash", params, 200,
+          [&]() { strip->SetupMultiColorFlash(n, multicolors, multidurations, rnd, 5000); active = false; },
+          [&](unsigned long now) { strip->MultiColorFlash(now, &active); });
+    }
+
+static const int flashdurations[] = {20, 200};
+for (int d : flashdurations)
+  {
+  snprintf(params, sizeof(params), "col1=col2=%dms", d);
+  Bench("RGBStrip::TwoColorFlash", params, 200,
+        [&]() { strip->SetupTwoColorFlash(blue, yellow, d, d, 10000); active = false; },
+        [&](unsigned long now) { strip->TwoColorFlash(now, &active); });
+  }
+
+static const int fadesteps[] = {1, 5};
+static const int fadespeeds[] = {1, 10};
+for (int step : fadesteps)
+  for (int speed : fadespeeds)
+    {
+    snprintf(params, sizeof(params), "step=%d speed=%d", step, speed);
+    Bench("RGBStrip::TwoColorFade", params, 200,
+          [&]() { strip->SetupTwoColorFade(0x000080, 0x2e8b57, step, speed, 5000); active = false; },
+          [&](unsigned long now) { strip->TwoColorFade(now, &active); });
+    }
+
+// ------------ Std12VOutput ----------------
+Bench("Std12VOutput::Output", "", 200,
+      [&]() {},
+      [&](unsigned long now) { output->Output(now & 0xff); });
+Bench("Std12VOutput::OutputWithDelay", "delay=500", 200,
+      [&]() { active = false; },
+      [&](unsigned long now) { output->OutputWithDelay(200, 500, now, &active); });
+Bench("Std12VOutput::MakeFlashes", "flashes=3 length=50", 0,
+      [&]() {},
+      [&](unsigned long now) { (void)now; output->MakeFlashes(255, 3, 50); });
+Bench("Std12VOutput::Flashes", "flashes=3 length=50", 200,
+      [&]() { output->SetupFlashes(255, 3, 50); active = false; },
+      [&](unsigned long now) { (void)now; output->Flashes(now, &active); });
+
+// ------------ EffectScheduler: 6 strips and 2 shakers, as on a real machine ----------------
+static RGBStrip * strips[6];
+static Std12VOutput * shakers[2];
+static EffectScheduler * scheduler;
+scheduler = new EffectScheduler();
+for (i=0; i<6; i++)
+  {
+  strips[i] = new RGBStrip(20 + i*3, 21 + i*3, 22 + i*3);
+  scheduler->AddStrip(strips[i]);
+  }
+for (i=0; i<2; i++)
+  {
+  shakers[i] = new Std12VOutput(40 + i);
+  scheduler->AddOutput(shakers[i]);
+  }
+Bench("EffectScheduler::Tick", "6 strips + 2 outputs", 200,
+      [&]() {
+        strips[0]->SetRainbowSpeed(7);
+        scheduler->StartEffect(0, PLS_EFFECT_RAINBOW);
+        strips[1]->SetupMultiColorFlash(5, multicolors, multidurations, false, 30000);
+        scheduler->StartEffect(1, PLS_EFFECT_MULTICOLORFLASH);
+        strips[2]->SetupTwoColorFlash(blue, yellow, 100, 100, 30000);
+        scheduler->StartEffect(2, PLS_EFFECT_TWOCOLORFLASH);
+        strips[3]->SetupTwoColorFade(0x000080, 0x2e8b57, 1, 5, 30000);
+        scheduler->StartEffect(3, PLS_EFFECT_TWOCOLORFADE);
+        strips[4]->SetupFlashes(0xffffff, 100, 50);
+        scheduler->StartEffect(4, PLS_EFFECT_FLASHES);
+        strips[5]->SetRainbowSpeed(1);
+        scheduler->StartEffect(5, PLS_EFFECT_RAINBOW);
+        shakers[0]->SetupFlashes(255, 100, 80);
+        scheduler->StartEffect(6, PLS_EFFECT_FLASHES);
+        scheduler->StartPulse(7, 200, 30000);
+        },
+      [&](unsigned long now) { (void)now; scheduler->Tick(); });
+static FrameClock * clock100;
+clock100 = new FrameClock(100, PLS_FRAME_CATCHUP);
+Bench("EffectScheduler::Tick", "same, 100 Hz FrameClock", 200,
+      [&]() { scheduler->UseFrameClock(clock100); },
+      [&](unsigned long now) { (void)now; scheduler->Tick(); });
+Bench("FrameClock::Due", "100 Hz, loop=200us", 200,
+      [&]() { },
+      [&](unsigned long now) { (void)now; clock100->Due(); });
+
+// ------------ StripGroup: the same rainbow/fade on 8 strips ----------------
+static RGBStrip * groupstrips[8];
+static StripGroup * group;
+group = new StripGroup();
+for (i=0; i<8; i++)
+  {
+  groupstrips[i] = new RGBStrip(60 + i*3, 61 + i*3, 62 + i*3);
+  group->AddStrip(groupstrips[i]);
+  }
+Bench("RGBStrip::RainbowColorChange", "8 strips, each its own", 200,
+      [&]() { for (i=0; i<8; i++) groupstrips[i]->SetRainbowSpeed(1); },
+      [&](unsigned long now) { for (int n=0; n<8; n++) groupstrips[n]->RainbowColorChange(now); });
+Bench("StripGroup::RainbowColorChange", "8 strips, in sync", 200,
+      [&]() { groupstrips[0]->SetRainbowSpeed(1); },
+      [&](unsigned long now) { group->RainbowColorChange(now); });
+Bench("StripGroup::RainbowColorChange", "8 strips, phase offsets", 200,
+      [&]() { for (i=1; i<8; i++) group->SetPhaseOffset(i, i * 8192); },
+      [&](unsigned long now) { group->RainbowColorChange(now); });
+Bench("StripGroup::Update", "8 strips, fade on the leader", 200,
+      [&]() { groupstrips[0]->SetupTwoColorFade(0x000080, 0x2e8b57, 1, 5, 30000); active = false; },
+      [&](unsigned long now) { groupstrips[0]->TwoColorFade(now, &active); group->Update(); });
+
+// ------------ BAMOutput: 5 strips on pins 44..58 (3 ports), software PWM ----------------
+static RGBStrip * bamstrips[5];
+for (i=0; i<5; i++)
+  {
+  bamstrips[i] = new RGBStrip(44 + i*3, 45 + i*3, 46 + i*3);
+  bamstrips[i]->UseBAM();
+  }
+BAMOutput::Start(200);
+Bench("RGBStrip::LightStrip(r,g,b)", "BAM pins", 200,
+      [&]() { },
+      [&](unsigned long now) { bamstrips[0]->LightStrip(now & 0xff, 128, 255); });
+Bench("BAMOutput::HandleInterrupt", "5 strips, 3 ports", 200,
+      [&]() { for (i=0; i<5; i++) bamstrips[i]->LightStrip(0x808000 + i*40); },
+      [&](unsigned long now) { (void)now; BAMOutput::HandleInterrupt(); });
+
+Bench("RGBStrip::Keyframes", "5 keys, ping-pong", 200,
+      [&]() { strip->SetupKeyframes(benchpalette, 5, PLS_KEY_PINGPONG); active = false; },
+      [&](unsigned long now) { strip->Keyframes(now, &active); });
+
+// ------------ ShowPlayer ----------------
+static ShowPlayer * player;
+player = new ShowPlayer(strip);
+Bench("ShowPlayer::Update", "fade/flash/rainbow show", 200,
+      [&]() { player->Start(benchshow); },
+      [&](unsigned long now) { player->Update(now); });
+
+// ------------ FrameReceiver: 6 strips per frame ----------------
+static FrameStream framestream;
+static FrameReceiver * receiver;
+receiver = new FrameReceiver(&framestream);
+for (i=0; i<6; i++)
+  receiver->AddStrip(strips[i]);
+framestream.frame[0] = PLS_FRAME_SYNC;
+framestream.frame[1] = 0x3f;
+framestream.frame[20] = PlsCrc8(0, 0x3f);
+for (i=2; i<20; i++)
+  {
+  framestream.frame[i] = i * 13;
+  framestream.frame[20] = PlsCrc8(framestream.frame[20], i * 13);
+  }
+framestream.pos = 0;
+Bench("FrameReceiver::Poll", "one 6 strip frame (21 bytes)", 200,
+      [&]() { },
+      [&](unsigned long now) { (void)now; framestream.left = sizeof(framestream.frame); receiver->Poll(); });
+
+// ------------ inputs ----------------
+Bench("Switch::ReadSwitch", "", 200,
+      [&]() { MockSetPinSource(14, BallRollingThrough); },
+      [&](unsigned long now) { (void)now; sw->ReadSwitch(); });
+Bench("Switch::ReadSwitchDelayed", "switchwait=100", 200,
+      [&]() { MockSetPinSource(14, BallRollingThrough); },
+      [&](unsigned long now) { sw->ReadSwitchDelayed(now); });
+Bench("OptoSwitch::ReadSwitch", "", 200,
+      [&]() { MockSetPinSource(15, BallRollingThrough); },
+      [&](unsigned long now) { (void)now; opto->ReadSwitch(); });
+Bench("OptoSwitch::ReadSwitchDelayed", "switchwait=100", 200,
+      [&]() { MockSetPinSource(15, BallRollingThrough); },
+      [&](unsigned long now) { opto->ReadSwitchDelayed(now); });
+Bench("Insert::InsertOn", "lamp on", 200,
+      [&]() { MockSetPinSource(16, LampMatrixOn); },
+      [&](unsigned long now) { insert->InsertOn(now); });
+Bench("Insert::GetBlinkInsertState", "lamp on", 200,
+      [&]() { MockSetPinSource(16, LampMatrixOn); },
+      [&](unsigned long now) { insert->GetBlinkInsertState(now); });
+Bench("Insert::GetBlinkInsertState", "lamp blinking 2Hz", 200,
+      [&]() { MockSetPinSource(16, LampMatrixBlinking); },
+      [&](unsigned long now) { insert->GetBlinkInsertState(now); });
+static Insert * adaptiveinsert;
+adaptiveinsert = new Insert(16, 20, 600, 600);
+adaptiveinsert->SetAdaptiveDelays(true);
+Bench("Insert::GetBlinkInsertState", "blinking 2Hz, adaptive delays", 200,
+      [&]() { MockSetPinSource(16, LampMatrixBlinking); },
+      [&](unsigned long now) { adaptiveinsert->GetBlinkInsertState(now); });
+static Insert * captureinsert;
+captureinsert = new Insert(18, 20, 600, 600);
+captureinsert->EnableEdgeCapture();
+Bench("Insert::GetBlinkInsertState", "blinking 2Hz, edge capture", 200,
+      [&]() { MockSetPinChangeHook(PinChangeInterrupt); MockSetPinSource(18, LampMatrixBlinking); },
+      [&](unsigned long now) { captureinsert->GetBlinkInsertState(now); });
+Bench("StdInput::ReadInput", "", 200,
+      [&]() { MockSetPin(17, HIGH); },
+      [&](unsigned long now) { (void)now; input->ReadInput(); });
+
+// ------------ SwitchBank: 24 inputs of a Switch Shield read once per loop ----------------
+static Switch * bankswitches[24];
+static SwitchBank * bank;
+static Switch * banksw;
+bank = new SwitchBank();
+for (i=0; i<24; i++)
+  bankswitches[i] = new Switch(22 + i);
+// the bank case is the whole cost of a loop: one Update() and all 24 reads
+static double directcyc, directerror, bankcyc, bankerror;
+directcyc = Bench("Switch::ReadSwitch", "24 switches, digitalRead", 200,
+                  [&]() { MockSetPinSource(30, BallRollingThrough); },
+                  [&](unsigned long now) { (void)now; for (int n=0; n<24; n++) bankswitches[n]->ReadSwitch(); },
+                  &directerror);
+for (i=0; i<24; i++)
+  bankswitches[i]->UseSwitchBank(bank);
+Bench("SwitchBank::Update", "24 inputs on 3 ports", 200,
+      [&]() { MockSetPinSource(30, BallRollingThrough); },
+      [&](unsigned long now) { (void)now; bank->Update(); });
+bankcyc = Bench("Switch::ReadSwitch", "24 switches, Update+24 reads", 200,
+                [&]() { MockSetPinSource(30, BallRollingThrough); },
+                [&](unsigned long now) { (void)now; bank->Update(); for (int n=0; n<24; n++) bankswitches[n]->ReadSwitch(); },
+                &bankerror);
+if (directcyc > 0 && bankcyc > 0)
+  printf("  SwitchBank saves %.0f +- %.0f AVR cycles per loop (24 switches, Update and all reads)\n",
+         directcyc - bankcyc, sqrt(directerror * directerror + bankerror * bankerror));
+static SwitchDebouncer32 * debouncer;
+debouncer = new SwitchDebouncer32(1);
+for (i=0; i<24; i++)
+  debouncer->SetHoldTime(i, 100);
+Bench("SwitchDebouncer32::Update", "24 inputs, hold=100", 200,
+      [&]() { MockSetPinSource(30, BallRollingThrough); },
+      [&](unsigned long now) { bank->Update(); debouncer->Update(bank->GetState(), now); });
+banksw = new Switch(14, 100);
+banksw->UseSwitchBank(bank);
+Bench("Switch::ReadSwitchDelayed", "switchwait=100, SwitchBank", 200,
+      [&]() { MockSetPinSource(14, BallRollingThrough); },
+      [&](unsigned long now) { bank->Update(); banksw->ReadSwitchDelayed(now); });
+
+// ------------ InputEvents: the same 24 switches, only the changed ones cost time ----------------
+static InputEvents * events;
+static unsigned long nrofevents;
+events = new InputEvents();
+for (i=0; i<24; i++)
+  events->AddSwitch(bankswitches[i]);
+events->OnEvent([](const PlsEvent & event) { nrofevents += event.type == PLS_EVENT_PRESS; });
+Bench("InputEvents::Update", "24 switches, SwitchBank", 200,
+      [&]() { MockSetPinSource(30, BallRollingThrough); },
+      [&](unsigned long now) { bank->Update(); events->Update(now); events->Dispatch(); });
+events->AddInsert(new Insert(18, 30, 600, 600));
+Bench("InputEvents::Update", "24 switches + Insert blinking", 200,
+      [&]() { MockSetPinSource(30, BallRollingThrough); MockSetPinSource(18, LampMatrixBlinking); },
+      [&](unsigned long now) { bank->Update(); events->Update(now); events->Dispatch(); });
+
+// ------------ RuleEngine: 16 rules on the same switches, 4 outputs ----------------
+static EffectScheduler * rulescheduler;
+static RuleEngine * rules;
+rulescheduler = new EffectScheduler();
+for (i=0; i<4; i++)
+  rulescheduler->AddOutput(new Std12VOutput(2 + i));
+rules = new RuleEngine(rulescheduler, bank);
+rules->UseRules(&_benchrules);
+Bench("RuleEngine::Update", "16 rules, 24 switches", 200,
+      [&]() { MockSetPinSource(30, BallRollingThrough); },
+      [&](unsigned long now) { bank->Update(); rules->Update(now); rulescheduler->Tick(); });
+
+// ------------ AddressableStrip: 60 pixels in 6 segments of 10 ----------------
+static byte pixelbuffer[60 * 3];
+static AddressableStrip * pixels;
+static RGBStrip * segments[6];
+pixels = new AddressableStrip(8, pixelbuffer, 60);
+for (i=0; i<6; i++)
+  {
+  segments[i] = new RGBStrip(pixels, i * 10, 10);
+  segments[i]->SetRainbowSpeed(1 + i);
+  }
+Bench("AddressableStrip::Show", "rainbow on segment 0", 200,
+      [&]() { },
+      [&](unsigned long now) { segments[0]->RainbowColorChange(now); pixels->Show(); });
+Bench("AddressableStrip::Show", "rainbow on 6 segments", 200,
+      [&]() { },
+      [&](unsigned long now) { for (int n=0; n<6; n++) segments[n]->RainbowColorChange(now); pixels->Show(); });
+
+// ------------ EepromConfig: the 6 strips and 2 Inserts of a machine, Load() is the startup cost ----------------
+static EepromConfig * config;
+static Insert * configinserts[2];
+config = new EepromConfig();
+for (i=0; i<6; i++)
+  config->AddStrip(strips[i]);
+for (i=0; i<2; i++)
+  configinserts[i] = new Insert(50 + i, 20, 300, 300);
+for (i=0; i<2; i++)
+  config->AddInsert(configinserts[i]);
+auto saveconfig = [&]() {
+  config->BeginSave();
+  for (int n=0; n<6; n++)
+    config->SaveBrightness(n, 80, true);
+  config->SaveMultiColorFlash(1, 5, multicolors, multidurations, false, 30000);
+  config->SaveTwoColorFade(3, 0x000080, 0x2e8b57, 1, 5, 30000);
+  config->SaveRainbowSpeed(0, 7);
+  config->SaveRainbowSpeed(5, 1);
+  for (int n=0; n<2; n++)
+    config->SaveInsertDelays(n, 30, 400, 400);
+  config->EndSave();
+  };
+Bench("EepromConfig::Load", "6 strips + 2 Inserts", 200,
+      [&]() { saveconfig(); },
+      [&](unsigned long now) { (void)now; config->Load(); });
+Bench("EepromConfig::EndSave", "same config again", 200,
+      [&]() { },
+      [&](unsigned long now) { (void)now; saveconfig(); });
+
+return 0;
+}
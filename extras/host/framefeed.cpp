@@ -0,0 +1,241 @@
+/* -----------------------------------------------------------
+ framefeed.cpp  -  PC side of the FrameReceiver protocol
+ Released into the public domain.
+
+ Without arguments it checks FrameReceiver on the PC: the frames are
+ written into a pseudo terminal and the host-side Serial reads them
+ from the other end, like the board reads them from the USB serial port.
+
+   g++ -O2 -I extras/host -I . pls.cpp extras/host/Arduino.cpp \
+       extras/host/framefeed.cpp -o framefeed
+   ./framefeed
+
+ With a serial device it sends a rainbow to a board that runs a sketch
+ with a FrameReceiver (Serial.begin(115200)):
+
+   ./framefeed /dev/ttyACM0 [frames per second] [number of strips]
+---------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <chrono>
+#include "Arduino.h"
+#include "pls.h"
+
+#define NR_OF_STRIPS	6
+#define BAUD		115200
+
+static int _failures = 0;
+
+// ------------ Function to build a frame, returns its length ------------
+static int BuildFrame(byte * frame, byte mask, byte colors[][3])
+{
+int len = 0, i;
+byte crc;
+
+frame[len++] = PLS_FRAME_SYNC;
+frame[len++] = mask;
+crc = PlsCrc8(0, mask);
+for (i=0; i<PLS_MAX_FRAME_STRIPS; i++)
+  {
+  if (!(mask & (1 << i)))
+    continue;
+  frame[len++] = colors[i][0];
+  frame[len++] = colors[i][1];
+  frame[len++] = colors[i][2];
+  crc = PlsCrc8(crc, colors[i][0]);
+  crc = PlsCrc8(crc, colors[i][1]);
+  crc = PlsCrc8(crc, colors[i][2]);
+  }
+frame[len++] = crc;
+return len;
+}
+
+static void Check(const char * what, boolean ok)
+{
+printf("%-58s %s\n", what, ok ? "ok" : "FAILED");
+if (!ok)
+  _failures++;
+}
+
+static void SetRaw(int fd, speed_t speed)
+{
+struct termios tio;
+
+tcgetattr(fd, &tio);
+cfmakeraw(&tio);
+cfsetispeed(&tio, speed);
+cfsetospeed(&tio, speed);
+tcsetattr(fd, TCSANOW, &tio);
+}
+
+// ------------ self check over a pseudo terminal ------------
+static int SelfTest()
+{
+static RGBStrip * strips[NR_OF_STRIPS];
+static byte colors[PLS_MAX_FRAME_STRIPS][3];
+byte frame[2 + PLS_MAX_FRAME_STRIPS * 3 + 1];
+int master, slave, len, i, j, k, split;
+boolean same;
+unsigned long frames, errors, shown;
+std::chrono::steady_clock::time_point start;
+double ns;
+
+master = posix_openpt(O_RDWR | O_NOCTTY);
+if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+  {
+  perror("posix_openpt");
+  return 2;
+  }
+slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+if (slave < 0)
+  {
+  perror("open pty");
+  return 2;
+  }
+SetRaw(slave, B115200);		// no line discipline, bytes go through unchanged
+MockReset();
+MockSerialAttach(slave);
+FrameReceiver receiver(&Serial);
+for (i=0; i<NR_OF_STRIPS; i++)
+  {
+  strips[i] = new RGBStrip(2 + i*3, 3 + i*3, 4 + i*3);
+  receiver.AddStrip(strips[i]);
+  }
+srand(1);
+
+// 1. clean frames, written in random pieces; the strips must show every frame
+same = true;
+shown = 0;
+for (k=0; k<1000; k++)
+  {
+  for (i=0; i<NR_OF_STRIPS; i++)
+    for (j=0; j<3; j++)
+      colors[i][j] = rand() & 0xff;
+  len = BuildFrame(frame, 0x3f, colors);
+  split = rand() % len;
+  if (write(master, frame, split) != split || write(master, frame + split, len - split) != len - split)
+    return 2;
+  shown += receiver.Poll();
+  for (i=0; i<NR_OF_STRIPS; i++)
+    same = same && MockGetDuty(2 + i*3) == colors[i][0] && MockGetDuty(3 + i*3) == colors[i][1] &&
+           MockGetDuty(4 + i*3) == colors[i][2];
+  }
+Check("1000 frames in pieces: every frame shown", same && shown == 1000 && receiver.GetErrors() == 0);
+
+// 2. every 4th frame has a flipped bit: it is dropped, the strips keep the last good one
+frames = receiver.GetFrames();
+errors = receiver.GetErrors();
+same = true;
+for (k=0; k<200; k++)
+  {
+  byte good[3] = {colors[0][0], colors[0][1], colors[0][2]};
+
+  for (j=0; j<3; j++)
+    colors[0][j] = rand() & 0xff;
+  len = BuildFrame(frame, 0x01, colors);
+  if (k % 4 == 3)
+    frame[2 + rand() % 3] ^= 1 << (rand() % 8);
+  if (write(master, frame, len) != len)
+    return 2;
+  receiver.Poll();
+  if (k % 4 == 3)
+    {
+    same = same && MockGetDuty(2) == good[0] && MockGetDuty(3) == good[1] && MockGetDuty(4) == good[2];
+    memcpy(colors[0], good, 3);
+    }
+  else
+    same = same && MockGetDuty(2) == colors[0][0];
+  }
+Check("200 frames, 50 corrupted: corrupted ones dropped", same &&
+      receiver.GetFrames() - frames == 150 && receiver.GetErrors() - errors == 50);
+
+// 3. line noise (without a sync byte) between the frames is skipped
+frames = receiver.GetFrames();
+for (k=0; k<100; k++)
+  {
+  byte noise[8];
+
+  for (j=0; j<8; j++)
+    {
+    noise[j] = rand() & 0xff;
+    if (noise[j] == PLS_FRAME_SYNC)
+      noise[j] = 0;
+    }
+  len = BuildFrame(frame, 0x3f, colors);
+  if (write(master, noise, sizeof(noise)) != sizeof(noise) || write(master, frame, len) != len)
+    return 2;
+  receiver.Poll();
+  }
+Check("100 frames with noise in between: all shown", receiver.GetFrames() - frames == 100);
+
+// 4. parsing cost, frames are written in bursts that fit the pty buffer
+MockResetStats();
+frames = receiver.GetFrames();
+start = std::chrono::steady_clock::now();
+for (k=0; k<20000; k++)
+  {
+  colors[k % NR_OF_STRIPS][k % 3] = k;
+  len = BuildFrame(frame, 0x3f, colors);
+  if (write(master, frame, len) != len)
+    return 2;
+  if (k % 32 == 31)
+    receiver.Poll();
+  }
+receiver.Poll();
+ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+Check("20000 frames in bursts: all shown", receiver.GetFrames() - frames == 20000);
+printf("\n%d strips: %d bytes per frame, %d frames/s possible at %d baud\n", NR_OF_STRIPS, len,
+       BAUD / 10 / len, BAUD);
+printf("host: %.0f ns per frame (incl. pty), %lu analogWrite calls per frame\n", ns / 20000,
+       MockStats.analogWrite / 20000);
+
+close(slave);
+close(master);
+printf("%s\n", _failures ? "FAILED" : "all checks passed");
+return _failures ? 1 : 0;
+}
+
+// ------------ sends a rainbow to a board ------------
+static int Feed(const char * device, int fps, int nrofstrips)
+{
+byte colors[PLS_MAX_FRAME_STRIPS][3];
+byte frame[2 + PLS_MAX_FRAME_STRIPS * 3 + 1];
+unsigned int phase = 0;
+int fd, len, i;
+byte mask = (1 << nrofstrips) - 1;
+
+fd = open(device, O_RDWR | O_NOCTTY);
+if (fd < 0)
+  {
+  perror(device);
+  return 2;
+  }
+SetRaw(fd, B115200);
+sleep(2);			// most boards reset when the port is opened
+printf("sending %d frames/s for %d strips to %s, stop with Ctrl-C\n", fps, nrofstrips, device);
+for (;;)
+  {
+  for (i=0; i<nrofstrips; i++)	// every strip a bit further in the rainbow
+    Phase2RGB(phase + i * (65536 / nrofstrips), &colors[i][0], &colors[i][1], &colors[i][2]);
+  len = BuildFrame(frame, mask, colors);
+  if (write(fd, frame, len) != len)
+    {
+    perror("write");
+    return 2;
+    }
+  phase += 65536 / (4 * fps);	// one rainbow cycle in 4 s
+  usleep(1000000 / fps);
+  }
+}
+
+int main(int argc, char * argv[])
+{
+if (argc < 2)
+  return SelfTest();
+return Feed(argv[1], argc > 2 ? constrain(atoi(argv[2]), 1, 500) : 100,
+            argc > 3 ? constrain(atoi(argv[3]), 1, PLS_MAX_FRAME_STRIPS) : NR_OF_STRIPS);
+}
@@ -0,0 +1,297 @@
+/* -----------------------------------------------------------
+ render.cpp  -  runs light effects on the PC and checks their output
+ Released into the public domain.
+
+ Runs a sketch on the virtual clock of the host Arduino core and records
+ every analogWrite/digitalWrite. Nothing waits for real time, so a show of
+ 10 minutes takes well under a second. The trace is summed up per second
+ of show time (number of writes, a hash of all writes with their time in
+ us and the duty of every pin at the end of the second) and compared with
+ a golden file, so any change of a color or of the timing is found and
+ the first second that differs is reported.
+
+   g++ -O2 -I extras/host -I . pls.cpp extras/host/Arduino.cpp \
+       extras/host/render.cpp -o render
+   ./render -g extras/host/golden/sketch.txt sketch
+
+   scenario       sketch (ShowLightEffects.ino, default), scheduler or
+                  frameclock (the scheduler on a 100 Hz FrameClock)
+   -t seconds     show time to run (default 600)
+   -a us          time every millis()/micros() call takes (default 20), this
+                  is how fast the loops of the sketch run
+   -g file        compare with a golden file, exit code 1 if it differs
+   -w file        write a new golden file
+   -c file        write every single write as CSV (us,pin,duty)
+
+ Note that int has 32 bits on the PC but 16 bits on the board, so errors
+ that come from an int overflowing at 32767 only show up on the board.
+---------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <chrono>
+#include "Arduino.h"
+#include "pls.h"
+
+// the sketch is compiled as it is, with its own setup() and loop()
+#include "../../ShowLightEffects.ino"
+
+#define MAX_TRACED_PINS	8
+#define LINE_LENGTH	128
+
+// ------------ a second sketch: several effects driven by the EffectScheduler ------------
+static RGBStrip * _schedstrips[2];
+static Std12VOutput * _schedoutput;
+static EffectScheduler * _scheduler;
+
+static void SchedulerSetup()
+{
+_schedstrips[0] = new RGBStrip(9, 10, 11);
+_schedstrips[1] = new RGBStrip(44, 45, 46);
+_schedoutput = new Std12VOutput(7);
+_scheduler = new EffectScheduler();
+_scheduler->AddStrip(_schedstrips[0]);
+_scheduler->AddStrip(_schedstrips[1]);
+_scheduler->AddOutput(_schedoutput);
+_schedstrips[1]->SetRainbowSpeed(3);
+_scheduler->StartEffect(1, PLS_EFFECT_RAINBOW);
+}
+
+static void SchedulerLoop()
+{
+static byte turn = 0;
+
+if (!_scheduler->EffectActive(0))	// fade and flashes take turns
+  {
+  if (turn & 1)
+    {
+    _schedstrips[0]->SetupFlashes(ORANGE, 5, 80);
+    _scheduler->StartEffect(0, PLS_EFFECT_FLASHES);
+    }
+  else
+    {
+    _schedstrips[0]->SetupTwoColorFade(NAVY, SEAGREEN, 1, 3, 4000);
+    _scheduler->StartEffect(0, PLS_EFFECT_TWOCOLORFADE);
+    }
+  turn++;
+  }
+if (!_scheduler->EffectActive(2))
+  _scheduler->StartPulse(2, 200, 300);
+_scheduler->Tick();
+}
+
+// ------------ the same sketch with the effects on a 100 Hz FrameClock ------------
+static FrameClock * _schedclock;
+
+static void FrameClockSetup()
+{
+SchedulerSetup();
+_schedclock = new FrameClock(100, PLS_FRAME_CATCHUP);
+_scheduler->UseFrameClock(_schedclock);
+}
+
+struct Scenario
+{
+  const char * name;
+  void (*setup)();
+  void (*loop)();
+  byte pins[MAX_TRACED_PINS];		// pins shown in the summary, 0 = end
+};
+
+static const Scenario _scenarios[] = {
+  {"sketch", setup, loop, {5, 6, 3}},
+  {"scheduler", SchedulerSetup, SchedulerLoop, {9, 10, 11, 44, 45, 46, 7}},
+  {"frameclock", FrameClockSetup, SchedulerLoop, {9, 10, 11, 44, 45, 46, 7}},
+};
+
+// ------------ the trace ------------
+struct EndOfShow {};			// thrown by the write hook when the show time is over
+
+static const Scenario * _scenario;
+static unsigned long long _endus;
+static unsigned long _second;		// second of show time being summed up
+static unsigned long _writes;
+static uint32_t _hash;
+static unsigned long _totalwrites;
+static int _duty[MOCK_NUM_PINS];
+static FILE * _csv;
+static char (*_lines)[LINE_LENGTH];	// one summary line per second
+static unsigned long _nroflines;
+
+static void HashBytes(const void * data, int len)
+{
+const byte * p = (const byte *)data;
+
+while (len--)
+  {
+  _hash ^= *p++;
+  _hash *= 16777619UL;		// FNV-1a
+  }
+}
+
+static void EndSecond()
+{
+int len, i;
+
+len = snprintf(_lines[_nroflines], LINE_LENGTH, "%lu %lu %08lx", _second, _writes, (unsigned long)_hash);
+for (i=0; i<MAX_TRACED_PINS && _scenario->pins[i]; i++)
+  len += snprintf(_lines[_nroflines] + len, LINE_LENGTH - len, " %d", _duty[_scenario->pins[i]]);
+_nroflines++;
+_second++;
+_writes = 0;
+_hash = 2166136261UL;
+}
+
+static void RecordWrite(int pin, int val, unsigned long long us)
+{
+uint32_t t;
+
+if (us >= _endus)
+  throw EndOfShow();
+while (us / 1000000 > _second)
+  EndSecond();
+t = (uint32_t)(us % 1000000);
+HashBytes(&t, sizeof(t));
+HashBytes(&pin, sizeof(pin));
+HashBytes(&val, sizeof(val));
+_duty[pin] = val;
+_writes++;
+_totalwrites++;
+if (_csv)
+  fprintf(_csv, "%llu,%d,%d\n", us, pin, val);
+}
+
+// ------------ Function to compare the summary with a golden file, returns the number of different seconds ------------
+static unsigned long Compare(const char * filename)
+{
+FILE * f;
+char line[LINE_LENGTH];
+unsigned long i = 0, diffs = 0;
+
+f = fopen(filename, "r");
+if (!f)
+  {
+  perror(filename);
+  return 1;
+  }
+while (fgets(line, sizeof(line), f))
+  {
+  line[strcspn(line, "\n")] = 0;
+  if (line[0] == '#')
+    continue;
+  if (i >= _nroflines || strcmp(line, _lines[i]) != 0)
+    {
+    if (!diffs)
+      printf("first difference at second %lu:\n  golden: %s\n  now:    %s\n", i, line,
+             i < _nroflines ? _lines[i] : "(show is over)");
+    diffs++;
+    }
+  i++;
+  }
+fclose(f);
+if (i != _nroflines)
+  {
+  if (!diffs)
+    printf("golden file has %lu seconds, the show %lu\n", i, _nroflines);
+  diffs++;
+  }
+return diffs;
+}
+
+static boolean WriteGolden(const char * filename)
+{
+FILE * f;
+unsigned long i;
+int j;
+
+f = fopen(filename, "w");
+if (!f)
+  {
+  perror(filename);
+  return false;
+  }
+fprintf(f, "# %s: second, writes, hash of the writes, duty of pin", _scenario->name);
+for (j=0; j<MAX_TRACED_PINS && _scenario->pins[j]; j++)
+  fprintf(f, " %d", _scenario->pins[j]);
+fprintf(f, "\n");
+for (i=0; i<_nroflines; i++)
+  fprintf(f, "%s\n", _lines[i]);
+fclose(f);
+return true;
+}
+
+int main(int argc, char * argv[])
+{
+unsigned long seconds = 600, advance = 20, diffs;
+const char * golden = 0, * newgolden = 0, * csvname = 0, * name = "sketch";
+std::chrono::steady_clock::time_point start;
+double ms;
+unsigned int i;
+int arg;
+
+for (arg=1; arg<argc; arg++)
+  {
+  if (argv[arg][0] != '-')
+    name = argv[arg];
+  else if (arg + 1 >= argc)
+    break;
+  else if (!strcmp(argv[arg], "-t"))
+    seconds = atol(argv[++arg]);
+  else if (!strcmp(argv[arg], "-a"))
+    advance = atol(argv[++arg]);
+  else if (!strcmp(argv[arg], "-g"))
+    golden = argv[++arg];
+  else if (!strcmp(argv[arg], "-w"))
+    newgolden = argv[++arg];
+  else if (!strcmp(argv[arg], "-c"))
+    csvname = argv[++arg];
+  }
+_scenario = 0;
+for (i=0; i<sizeof(_scenarios) / sizeof(_scenarios[0]); i++)
+  if (!strcmp(name, _scenarios[i].name))
+    _scenario = &_scenarios[i];
+if (!_scenario || seconds == 0)
+  {
+  fprintf(stderr, "usage: %s [-t seconds] [-a us] [-g golden] [-w golden] [-c trace.csv] [sketch|scheduler|frameclock]\n", argv[0]);
+  return 2;
+  }
+if (csvname && !(_csv = fopen(csvname, "w")))
+  {
+  perror(csvname);
+  return 2;
+  }
+
+_lines = new char[seconds][LINE_LENGTH];
+_endus = (unsigned long long)seconds * 1000000;
+_hash = 2166136261UL;
+MockReset();
+MockSetSerialQuiet(true);
+MockSetAutoAdvance(advance);
+MockWriteHook = RecordWrite;
+start = std::chrono::steady_clock::now();
+try
+  {
+  _scenario->setup();
+  for (;;)
+    _scenario->loop();
+  }
+catch (EndOfShow &)
+  {
+  }
+while (_second < seconds)
+  EndSecond();
+MockWriteHook = 0;
+ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+if (_csv)
+  fclose(_csv);
+
+printf("%s: %lu s of show time in %.0f ms, %lu writes\n", _scenario->name, seconds, ms, _totalwrites);
+if (newgolden && !WriteGolden(newgolden))
+  return 2;
+if (golden)
+  {
+  diffs = Compare(golden);
+  printf("%s: %lu of %lu seconds differ\n", golden, diffs, seconds);
+  return diffs ? 1 : 0;
+  }
+return 0;
+}
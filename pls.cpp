@@ -10,10 +10,79 @@
 	      added function SwitchOff
 	      function LightStrip can now be used in 3 variants
 	      added function MultiColorFlash
+ Version 2:   brightness is applied with a fixed point factor instead of
+	      a division per color, added function SetGamma
+	      RGBStrip and Std12VOutput skip writes of unchanged PWM values
+	      added non-blocking Flashes and class EffectScheduler
+	      added class SwitchBank to read all inputs with one access per port
+	      added SwitchDebouncer8/16/32 (vertical counter debouncing)
+	      ReadSwitchDelayed no longer fails after 32s or when millis() is 0
+	      added class InsertCapture (pin change interrupts for Inserts)
+	      Inserts can measure their blink period and adapt their delays
+	      RainbowColorChange uses a phase accumulator (no divisions, no stale
+	      colors after missed calls), added SetRainbowRate and Phase2RGB
+	      added RGBStripT, Std12VOutputT, SwitchT, OptoSwitchT and StdInputT
+	      (pins as template parameters, direct register access on the Uno)
+	      the effects of RGBStrip share their memory, only the effect that
+	      was set up last keeps its state
+	      added class BAMOutput (software PWM on any pin), see UseBAM
+	      added class ShowPlayer to play light shows stored in flash
+	      added Keyframes effect (color palettes of any length from flash)
+	      added class FrameReceiver to set strips from a PC over Serial
+	      added class InputEvents (press/release/ON/OFF/BLINK events)
+	      added PLS_PROFILE and class PlsProfiler (loop time histogram,
+	      calls and time per method)
+	      added class RuleEngine (rules in flash start effects on inputs)
+	      added class AddressableStrip (WS2812 pixels), RGBStrips can be
+	      segments of it
+	      added HSV2RGB, HSV2Long and LightStripHSV (integer HSV colors)
+	      added class StripGroup (one effect shown in sync on several strips)
+	      added class FrameClock (fixed effect rate), EffectScheduler can use it;
+	      all durations are unsigned int (up to 65535 ms instead of 32767)
+	      added class EepromConfig (effect parameters stored in the EEPROM)
 ---------------------------------------------------------------*/
 
 #include "Arduino.h"
-#include "Pls.h"
+#include <avr/eeprom.h>
+#include "pls.h"
+
+// entries of the profile (PLS_PROFILE), same order as _profilenames
+#define PROF_LIGHTSTRIP			0
+#define PROF_RAINBOWCOLORCHANGE		1
+#define PROF_MULTICOLORFLASH		2
+#define PROF_TWOCOLORFLASH		3
+#define PROF_TWOCOLORFADE		4
+#define PROF_STRIPFLASHES		5
+#define PROF_KEYFRAMES			6
+#define PROF_OUTPUT			7
+#define PROF_OUTPUTWITHDELAY		8
+#define PROF_OUTPUTFLASHES		9
+#define PROF_SWITCHBANKUPDATE		10
+#define PROF_READSWITCH			11
+#define PROF_READSWITCHDELAYED		12
+#define PROF_OPTOREADSWITCH		13
+#define PROF_OPTOREADSWITCHDELAYED	14
+#define PROF_INSERTON			15
+#define PROF_GETBLINKINSERTSTATE	16
+#define PROF_READINPUT			17
+#define PROF_SCHEDULERTICK		18
+#define PROF_SHOWPLAYERUPDATE		19
+
+#if defined(PLS_PROFILE)
+// measures the time from its construction to the end of the enclosing block
+class PlsProfileScope
+{
+  public:
+    PlsProfileScope(byte entry) { _entry = entry; _start = micros(); }
+    ~PlsProfileScope() { PlsProfiler::Add(_entry, micros() - _start); }
+  private:
+    byte _entry;
+    unsigned long _start;
+};
+#define PLS_PROFILE_SCOPE(entry)	PlsProfileScope _profilescope(entry)
+#else
+#define PLS_PROFILE_SCOPE(entry)
+#endif
 
 
 // ------------ Function to copy one color into another one ---------
@@ -68,29 +137,227 @@ byte GetBlue(unsigned long color)
 return (color & 0x0000ff);
 }
 
+// ------------ CRC-8 table (polynomial 0x07, MSB first), kept in flash ---------
+static const byte _crc8table[256] PROGMEM = {
+  0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15, 0x38, 0x3f, 0x36, 0x31, 0x24, 0x23, 0x2a, 0x2d,
+  0x70, 0x77, 0x7e, 0x79, 0x6c, 0x6b, 0x62, 0x65, 0x48, 0x4f, 0x46, 0x41, 0x54, 0x53, 0x5a, 0x5d,
+  0xe0, 0xe7, 0xee, 0xe9, 0xfc, 0xfb, 0xf2, 0xf5, 0xd8, 0xdf, 0xd6, 0xd1, 0xc4, 0xc3, 0xca, 0xcd,
+  0x90, 0x97, 0x9e, 0x99, 0x8c, 0x8b, 0x82, 0x85, 0xa8, 0xaf, 0xa6, 0xa1, 0xb4, 0xb3, 0xba, 0xbd,
+  0xc7, 0xc0, 0xc9, 0xce, 0xdb, 0xdc, 0xd5, 0xd2, 0xff, 0xf8, 0xf1, 0xf6, 0xe3, 0xe4, 0xed, 0xea,
+  0xb7, 0xb0, 0xb9, 0xbe, 0xab, 0xac, 0xa5, 0xa2, 0x8f, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9d, 0x9a,
+  0x27, 0x20, 0x29, 0x2e, 0x3b, 0x3c, 0x35, 0x32, 0x1f, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0d, 0x0a,
+  0x57, 0x50, 0x59, 0x5e, 0x4b, 0x4c, 0x45, 0x42, 0x6f, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7d, 0x7a,
+  0x89, 0x8e, 0x87, 0x80, 0x95, 0x92, 0x9b, 0x9c, 0xb1, 0xb6, 0xbf, 0xb8, 0xad, 0xaa, 0xa3, 0xa4,
+  0xf9, 0xfe, 0xf7, 0xf0, 0xe5, 0xe2, 0xeb, 0xec, 0xc1, 0xc6, 0xcf, 0xc8, 0xdd, 0xda, 0xd3, 0xd4,
+  0x69, 0x6e, 0x67, 0x60, 0x75, 0x72, 0x7b, 0x7c, 0x51, 0x56, 0x5f, 0x58, 0x4d, 0x4a, 0x43, 0x44,
+  0x19, 0x1e, 0x17, 0x10, 0x05, 0x02, 0x0b, 0x0c, 0x21, 0x26, 0x2f, 0x28, 0x3d, 0x3a, 0x33, 0x34,
+  0x4e, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5c, 0x5b, 0x76, 0x71, 0x78, 0x7f, 0x6a, 0x6d, 0x64, 0x63,
+  0x3e, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2c, 0x2b, 0x06, 0x01, 0x08, 0x0f, 0x1a, 0x1d, 0x14, 0x13,
+  0xae, 0xa9, 0xa0, 0xa7, 0xb2, 0xb5, 0xbc, 0xbb, 0x96, 0x91, 0x98, 0x9f, 0x8a, 0x8d, 0x84, 0x83,
+  0xde, 0xd9, 0xd0, 0xd7, 0xc2, 0xc5, 0xcc, 0xcb, 0xe6, 0xe1, 0xe8, 0xef, 0xfa, 0xfd, 0xf4, 0xf3
+};
+
+// ------------ Function to add one byte to a CRC-8 ---------
+byte PlsCrc8(byte crc, byte data)
+{
+return pgm_read_byte(&_crc8table[crc ^ data]);
+}
+
+/* ------------ Function to convert a position in the rainbow into a color ---------
+   The 16 bit phase runs through 6 sectors of 256 steps each:
+   blue -> violet -> red -> yellow -> green -> teal -> blue
+   Only shifts and one multiplication by 6, no divisions.
+*/
+void Phase2RGB(unsigned int phase, byte * red, byte * green, byte * blue)
+{
+unsigned int pos = ((unsigned long)(uint16_t)phase * 6) >> 8;	// sector in the high byte, ramp in the low byte
+byte ramp = pos & 0xff;
+
+switch (pos >> 8)
+  {
+  case 0:	// fade from blue to violet
+    *red = ramp; *green = 0; *blue = 255;
+    break;
+  case 1:	// fade from violet to red
+    *red = 255; *green = 0; *blue = 255 - ramp;
+    break;
+  case 2:	// fade from red to yellow
+    *red = 255; *green = ramp; *blue = 0;
+    break;
+  case 3:	// fade from yellow to green
+    *red = 255 - ramp; *green = 255; *blue = 0;
+    break;
+  case 4:	// fade from green to teal
+    *red = 0; *green = 255; *blue = ramp;
+    break;
+  default:	// fade from teal to blue
+    *red = 0; *green = 255 - ramp; *blue = 255;
+    break;
+  }
+}
+
+/* ------------ Functions to convert hue, saturation and value into a color ---------
+   hue 0..255 runs through 6 sectors of about 43 steps each:
+   red -> yellow -> green -> cyan -> blue -> magenta -> red
+   hue * 6 gives the sector in the high byte and the position in it in the low
+   byte, the rest are multiplications with a shift by 8 (x * (y + 1) >> 8, which
+   is exact for y = 0 and y = 255). No divisions, no floating point.
+*/
+static inline byte Scale8(byte x, byte y)
+{
+return ((unsigned int)x * (y + 1)) >> 8;
+}
+
+static inline void HSVKernel(byte hue, byte sat, byte val, byte * red, byte * green, byte * blue)
+{
+unsigned int pos = hue * 6;		// sector in the high byte, ramp in the low byte
+byte ramp = pos & 0xff;
+byte low = Scale8(val, 255 - sat);			// the color that is off
+byte down = Scale8(val, 255 - Scale8(sat, ramp));	// falling edge of the sector
+byte up = Scale8(val, 255 - Scale8(sat, 255 - ramp));	// rising edge of the sector
+
+switch (pos >> 8)
+  {
+  case 0:	// red to yellow
+    *red = val; *green = up; *blue = low;
+    break;
+  case 1:	// yellow to green
+    *red = down; *green = val; *blue = low;
+    break;
+  case 2:	// green to cyan
+    *red = low; *green = val; *blue = up;
+    break;
+  case 3:	// cyan to blue
+    *red = low; *green = down; *blue = val;
+    break;
+  case 4:	// blue to magenta
+    *red = up; *green = low; *blue = val;
+    break;
+  default:	// magenta to red
+    *red = val; *green = low; *blue = down;
+    break;
+  }
+}
+
+void HSV2RGB(byte hue, byte sat, byte val, byte * red, byte * green, byte * blue)
+{
+HSVKernel(hue, sat, val, red, green, blue);
+}
+
+unsigned long HSV2Long(byte hue, byte sat, byte val)
+{
+byte red, green, blue;
+
+HSVKernel(hue, sat, val, &red, &green, &blue);
+return RGB2Long(red, green, blue);
+}
+
+// converts count colors in one call: hsv holds hue, saturation, value and rgb gets
+// red, green, blue for every color (hsv and rgb may be the same array)
+void HSV2RGB(const byte * hsv, byte * rgb, unsigned int count)
+{
+byte hue, sat, val;
+
+while (count--)
+  {
+  hue = hsv[0];
+  sat = hsv[1];
+  val = hsv[2];
+  HSVKernel(hue, sat, val, &rgb[0], &rgb[1], &rgb[2]);
+  hsv += 3;
+  rgb += 3;
+  }
+}
+
+
+// ------------ Gamma correction table (gamma 2.8), kept in flash ---------
+// LEDs are perceived as much brighter than their PWM duty suggests at low
+// values. With this table a linear change of a color value or of the
+// brightness also looks linear.
+static const byte _gammatable[256] PROGMEM = {
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   1,   1,   1,
+    1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+    2,   3,   3,   3,   3,   3,   3,   3,   4,   4,   4,   4,   4,   5,   5,   5,
+    5,   6,   6,   6,   6,   7,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,
+   10,  10,  11,  11,  11,  12,  12,  13,  13,  13,  14,  14,  15,  15,  16,  16,
+   17,  17,  18,  18,  19,  19,  20,  20,  21,  21,  22,  22,  23,  24,  24,  25,
+   25,  26,  27,  27,  28,  29,  29,  30,  31,  32,  32,  33,  34,  35,  35,  36,
+   37,  38,  39,  39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  50,
+   51,  52,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  66,  67,  68,
+   69,  70,  72,  73,  74,  75,  77,  78,  79,  81,  82,  83,  85,  86,  87,  89,
+   90,  92,  93,  95,  96,  98,  99, 101, 102, 104, 105, 107, 109, 110, 112, 114,
+  115, 117, 119, 120, 122, 124, 126, 127, 129, 131, 133, 135, 137, 138, 140, 142,
+  144, 146, 148, 150, 152, 154, 156, 158, 160, 162, 164, 167, 169, 171, 173, 175,
+  177, 180, 182, 184, 186, 189, 191, 193, 196, 198, 200, 203, 205, 208, 210, 213,
+  215, 218, 220, 223, 225, 228, 231, 233, 236, 239, 241, 244, 247, 249, 252, 255
+};
+
+
+// ------------ Function to write a PWM value only if it changed ---------
+// analogWrite is expensive (pin to timer lookup, register writes, special
+// cases for 0 and 255) and most effects write the same value on many passes
+// of loop(). Returns true if the value was actually written.
+// Pins attached to BAMOutput get their value from the bit planes instead.
+// BAMOutput::Attach sets _bamwrite, before that nothing here refers to BAMOutput,
+// so sketches without BAM don't link its bit planes (~66 bytes of RAM).
+static boolean (*_bamwrite)(int pin, byte duty) = 0;
+
+static boolean WriteDuty(int pin, int * lastduty, byte duty)
+{
+if (*lastduty == duty)
+  return false;
+*lastduty = duty;
+if (!_bamwrite || !_bamwrite(pin, duty))
+  analogWrite(pin, duty);
+return true;
+}
+
 
 // ===============================================================
 // Implementation of class RGBStrip
 
+#if defined(__AVR__)
+static_assert(sizeof(RGBStrip) <= 72, "RGBStrip got bigger than its RAM budget");
+#endif
+
 // -----------  Constructor for RGBStrip --------------
 
 RGBStrip::RGBStrip(int redpin, int greenpin, int bluepin, int brightness)
 {
 pinMode(redpin, OUTPUT);
 
-_redpin = redpin;
+_pixels = 0;
+_out.pins.red = redpin;
 pinMode(greenpin, OUTPUT);
-_greenpin = greenpin;
+_out.pins.green = greenpin;
 pinMode(bluepin, OUTPUT);
-_bluepin = bluepin;
+_out.pins.blue = bluepin;
+Init(brightness);
+}
+
+// A strip made of count pixels of an AddressableStrip, starting at pixel first. All
+// pixels of the segment show the same color, all effects work as on an analog strip.
+RGBStrip::RGBStrip(AddressableStrip * pixels, unsigned int first, unsigned int count, int brightness)
+{
+_pixels = pixels;
+_out.segment.first = first;
+_out.segment.count = count;
+Init(brightness);
+}
 
-_brightness = constrain(brightness, 0, 100);	// default value is full brightness
+void RGBStrip::Init(int brightness)
+{
+_gamma = false;
+SetBrightness(constrain(brightness, 0, 100));	// default value is full brightness
+
+_lastduty[0] = -1;	// nothing written yet, so the first write always happens
+_lastduty[1] = -1;
+_lastduty[2] = -1;
+ResetWriteCounters();
 
-_rainbowred = 0;
-_rainbowblue = 0;
-_rainbowgreen = 0;
-_startrainbow = 0;
-_fadespeed_rainbow = 7;
+_effect = PLS_EFFECT_NONE;
+UseEffect(PLS_EFFECT_RAINBOW);	// RainbowColorChange works without any setup
 
 SwitchOff();		// initially always switch it off
 }
@@ -99,23 +366,80 @@ SwitchOff();		// initially always switch it off
 
 void RGBStrip::LightStrip(unsigned long color)
 {
-analogWrite(_redpin, GetRed(color)*_brightness/100);
-analogWrite(_greenpin, GetGreen(color)*_brightness/100);
-analogWrite(_bluepin, GetBlue(color)*_brightness/100);
+Light(GetRed(color), GetGreen(color), GetBlue(color));
 }
 
 void RGBStrip::LightStrip(int redval, int greenval, int blueval)
 {
-analogWrite(_redpin, redval*_brightness/100);
-analogWrite(_greenpin, greenval*_brightness/100);
-analogWrite(_bluepin, blueval*_brightness/100);
+Light(constrain(redval, 0, 255), constrain(greenval, 0, 255), constrain(blueval, 0, 255));
 }
 
 void RGBStrip::LightStrip(int color[3])
 {
-analogWrite(_redpin, color[0]*_brightness/100);
-analogWrite(_greenpin, color[1]*_brightness/100);
-analogWrite(_bluepin, color[2]*_brightness/100);
+LightStrip(color[0], color[1], color[2]);
+}
+
+void RGBStrip::LightStripHSV(byte hue, byte sat, byte val)
+{
+byte red, green, blue;
+
+HSVKernel(hue, sat, val, &red, &green, &blue);
+Light(red, green, blue);
+}
+
+void RGBStrip::LightStripHSV(byte hsv[3])
+{
+LightStripHSV(hsv[0], hsv[1], hsv[2]);
+}
+
+// ------------ Function to keep a color and show it with brightness and gamma ---------
+// every LightStrip call ends here, the color is kept for StripGroup
+void RGBStrip::Light(byte red, byte green, byte blue)
+{
+_color[0] = red;
+_color[1] = green;
+_color[2] = blue;
+WriteColor(ScaleColor(red), ScaleColor(green), ScaleColor(blue));
+}
+
+// ------------ Function to write the final PWM values to the 3 pins (or the segment) ---------
+// only pins whose value changed are written, the others are counted as skipped
+void RGBStrip::WriteColor(byte red, byte green, byte blue)
+{
+PLS_PROFILE_SCOPE(PROF_LIGHTSTRIP);
+byte written;
+
+if (_pixels)
+  {
+  written = (_lastduty[0] != red) + (_lastduty[1] != green) + (_lastduty[2] != blue);
+  if (written)
+    {
+    _lastduty[0] = red;
+    _lastduty[1] = green;
+    _lastduty[2] = blue;
+    _pixels->Fill(_out.segment.first, _out.segment.count, red, green, blue);
+    }
+  }
+else
+  {
+  written = WriteDuty(_out.pins.red, &_lastduty[0], red);
+  written += WriteDuty(_out.pins.green, &_lastduty[1], green);
+  written += WriteDuty(_out.pins.blue, &_lastduty[2], blue);
+  }
+_writesissued += written;
+_writesskipped += 3 - written;
+}
+
+// ------------ Function to apply brightness (and gamma) to one color value ---------
+// The brightness is stored as a factor where 256 means 100%, so this costs one
+// multiplication and a shift instead of a multiplication and a division
+byte RGBStrip::ScaleColor(int val)
+{
+val = constrain(val, 0, 255);
+val = ((unsigned int)val * _brightscale) >> 8;
+if (_gamma)
+  return pgm_read_byte(&_gammatable[val]);
+return val;
 }
 
 void RGBStrip::SwitchOff()
@@ -144,181 +468,290 @@ for (i=1; i<=flashes; i++) {
   }
 }
 
-void RGBStrip::SetBrightness(int brightness)
+/* ----------- Function to select the effect whose state is kept --------
+   All effects share the same memory (_fx), so setting up one effect throws away
+   the state of the previous one, whose Setup function has to be called again
+   before it can run. The rainbow starts with the default speed.
+*/
+void RGBStrip::UseEffect(byte effect)
 {
-if (brightness >= 0 && brightness <= 100)
-  _brightness = brightness;
-else
-  _brightness = 100;
+if (_effect == effect)
+  return;
+memset(&_fx, 0, sizeof(_fx));
+_effect = effect;
+if (effect == PLS_EFFECT_RAINBOW)
+  SetRainbowSpeed(7);
 }
 
-void RGBStrip::RainbowColorChange(unsigned long CurrentMillis)
+/* -------- Function to flash the Strip without using delay() ---------
+   SetupFlashes prepares the flashes, Flashes has to be called in every pass
+   of loop() afterwards and sets FlashActive to false when all flashes are done.
+   Like MakeFlashes the strip stays on after the last flash.
+*/
+void RGBStrip::SetupFlashes(unsigned long color, int flashes, unsigned int flashlength)
 {
-int TimeExpired;
-// rainbow color change
-if (CurrentMillis - _startrainbow >= _fadespeed_rainbow*6*256)
+UseEffect(PLS_EFFECT_FLASHES);
+_fx.flashes.color = color;
+_fx.flashes.length = flashlength;
+flashes = constrain(flashes, 1, 127);
+_fx.flashes.phases = flashes*2 - 1;	// no off phase after the last flash
+_fx.flashes.phase = 0;
+}
+
+void RGBStrip::Flashes(unsigned long CurrentMillis, boolean * FlashActive)
+{
+PLS_PROFILE_SCOPE(PROF_STRIPFLASHES);
+if (_effect != PLS_EFFECT_FLASHES)	// not set up or another effect was set up since
   {
-  _startrainbow = CurrentMillis;
+  *FlashActive = false;
+  return;
   }
-else
+if (*FlashActive == false)   // called for the first time
   {
-  TimeExpired = CurrentMillis - _startrainbow;
-  // fade from blue to violet
-  if (TimeExpired < _fadespeed_rainbow*1*256)
-    {
-    _rainbowred = TimeExpired/_fadespeed_rainbow;
-    }
-  // fade from violet to red
-  else if (TimeExpired < _fadespeed_rainbow*2*256)
-    {
-    _rainbowblue = 255 - (TimeExpired - _fadespeed_rainbow*1*256)/_fadespeed_rainbow;
-    }
-  // fade from red to yellow
-  else if (TimeExpired < _fadespeed_rainbow*3*256)
-    {
-    _rainbowgreen = (TimeExpired - _fadespeed_rainbow*2*256)/_fadespeed_rainbow;
-    }
-  // fade from yellow to green
-  else if (TimeExpired < _fadespeed_rainbow*4*256)
-    {
-    _rainbowred = 255 - (TimeExpired - _fadespeed_rainbow*3*256)/_fadespeed_rainbow;
-    }
-  // fade from green to teal
-  else if (TimeExpired < _fadespeed_rainbow*5*256)
-    {
-    _rainbowblue = (TimeExpired - _fadespeed_rainbow*4*256)/_fadespeed_rainbow;
-    }
-  // fade from teal to blue
-  else if (TimeExpired < _fadespeed_rainbow*6*256)
+  _fx.flashes.lasttoggle = CurrentMillis;
+  _fx.flashes.phase = 0;
+  *FlashActive = true;
+  }
+else if (CurrentMillis - _fx.flashes.lasttoggle >= _fx.flashes.length)
+  {
+  _fx.flashes.lasttoggle = CurrentMillis;
+  _fx.flashes.phase++;
+  if (_fx.flashes.phase >= _fx.flashes.phases)	// last flash is over
     {
-    _rainbowgreen = 255 - (TimeExpired - _fadespeed_rainbow*5*256)/_fadespeed_rainbow;
+    *FlashActive = false;
+    return;
     }
-  } 
-LightStrip(_rainbowred, _rainbowgreen, _rainbowblue);
+  }
+
+if (_fx.flashes.phase & 1)	// odd phases are the pauses between the flashes
+  LightStrip((unsigned long)0);
+else
+  LightStrip(_fx.flashes.color);
+}
+
+// the only division happens here, once per change of the brightness
+void RGBStrip::SetBrightness(int brightness)
+{
+if (brightness < 0 || brightness > 100)
+  brightness = 100;
+_brightscale = ((unsigned int)brightness * 256 + 50) / 100;
+}
+
+// switch gamma correction on or off; with gamma correction dimming the
+// strip with SetBrightness looks linear to the eye
+void RGBStrip::SetGamma(boolean gamma)
+{
+_gamma = gamma;
+}
+
+// ------------ Functions to check how many PWM writes were saved ---------
+unsigned long RGBStrip::GetWritesIssued()
+{
+return _writesissued;
+}
+
+unsigned long RGBStrip::GetWritesSkipped()
+{
+return _writesskipped;
+}
+
+void RGBStrip::ResetWriteCounters()
+{
+_writesissued = 0;
+_writesskipped = 0;
+}
+
+// Function to drive the strip with BAMOutput, so it also works on pins without
+// hardware PWM. The strip is dark until the next LightStrip call.
+boolean RGBStrip::UseBAM()
+{
+if (_pixels)
+  return false;
+if (!BAMOutput::Attach(_out.pins.red) || !BAMOutput::Attach(_out.pins.green) || !BAMOutput::Attach(_out.pins.blue))
+  return false;
+_lastduty[0] = -1;	// the values have to be written to the bit planes
+_lastduty[1] = -1;
+_lastduty[2] = -1;
+return true;
+}
+
+/* ----------- rainbow color change --------
+   The phase is advanced by the time since the last call, so the color is always
+   the one that belongs to CurrentMillis, no matter how many calls were missed.
+   Only the low 24 bits of the accumulator are used, so the overflow of the
+   multiplication does no harm.
+*/
+void RGBStrip::RainbowColorChange(unsigned long CurrentMillis)
+{
+PLS_PROFILE_SCOPE(PROF_RAINBOWCOLORCHANGE);
+byte red, green, blue;
+
+UseEffect(PLS_EFFECT_RAINBOW);
+_fx.rainbow.phase += (CurrentMillis - _fx.rainbow.last) * _fx.rainbow.rate;
+_fx.rainbow.last = CurrentMillis;
+Phase2RGB(GetRainbowPhase(), &red, &green, &blue);
+LightStrip(red, green, blue);
 } /* rainbowColorChange */
 
+// speed = ms per color step, a full cycle takes 6*256*speed ms
 void RGBStrip::SetRainbowSpeed(int RainbowSpeed)
 {
-_fadespeed_rainbow = RainbowSpeed;
-if (_fadespeed_rainbow <= 0)
-  _fadespeed_rainbow = 1;
+if (RainbowSpeed <= 0)
+  RainbowSpeed = 1;
+SetRainbowRate((65536UL * 256 / (6 * 256) + RainbowSpeed / 2) / RainbowSpeed);
+}
+
+// rate = phase steps per ms in 1/256, e.g. 256 = one cycle in 65.5 s
+void RGBStrip::SetRainbowRate(unsigned int rate)
+{
+UseEffect(PLS_EFFECT_RAINBOW);
+_fx.rainbow.rate = rate;
+if (_fx.rainbow.rate == 0)
+  _fx.rainbow.rate = 1;
+}
+
+void RGBStrip::SetRainbowPhase(unsigned int phase)
+{
+UseEffect(PLS_EFFECT_RAINBOW);
+_fx.rainbow.phase = (unsigned long)phase << 8;
+}
+
+unsigned int RGBStrip::GetRainbowPhase()
+{
+return (uint16_t)(_fx.rainbow.phase >> 8);
 }
 
-void RGBStrip::SetupMultiColorFlash(byte nrofcolors, unsigned long colors[5], int durations[5], boolean                                                randsequence, int FlashDuration)
+void RGBStrip::SetupMultiColorFlash(byte nrofcolors, unsigned long colors[5], unsigned int durations[5], boolean                                                randsequence, unsigned int FlashDuration)
 {
 int i;
 
+UseEffect(PLS_EFFECT_MULTICOLORFLASH);
 if (nrofcolors > 5)
-  _nrofcolors = 5;
+  _fx.multi.nrofcolors = 5;
 else
-  _nrofcolors = nrofcolors;
-
-memcpy(_colors, colors, sizeof(_colors));
-memcpy(_durations, durations, sizeof(_durations));
-_randsequence = randsequence;
-_ActiveColorIndex = 0;  // always start with first color in array
-_MultiFlashDuration = FlashDuration;
-_MultiFlashStartTime = 0;
+  _fx.multi.nrofcolors = nrofcolors;
+
+memcpy(_fx.multi.colors, colors, sizeof(_fx.multi.colors));
+memcpy(_fx.multi.durations, durations, sizeof(_fx.multi.durations));
+_fx.multi.randsequence = randsequence;
+_fx.multi.activeindex = 0;  // always start with first color in array
+_fx.multi.duration = FlashDuration;
+_fx.multi.starttime = 0;
 }
 
 
 void RGBStrip::MultiColorFlash(unsigned long CurrentMillis, boolean * FlashActive)
 {
+PLS_PROFILE_SCOPE(PROF_MULTICOLORFLASH);
+if (_effect != PLS_EFFECT_MULTICOLORFLASH)	// not set up or another effect was set up since
+  {
+  *FlashActive = false;
+  return;
+  }
 if (*FlashActive == false)   // signal detected for the first time
   {
-  _MultiFlashStartTime = CurrentMillis;
-  _LastMultiColorSwitch = CurrentMillis;
+  _fx.multi.starttime = CurrentMillis;
+  _fx.multi.lastswitch = CurrentMillis;
   *FlashActive = true;
   }
 else              // we want to make sure, that this lasts for a while to really see some effect
   {
-  if (CurrentMillis - _MultiFlashStartTime > _MultiFlashDuration)
+  if (CurrentMillis - _fx.multi.starttime > _fx.multi.duration)
     {
     *FlashActive = false;
     return;
     }
   }
   
-if (CurrentMillis - _LastMultiColorSwitch >=    // determines the length of the flash               
-    _durations[_ActiveColorIndex])               // (different for each color)
+if (CurrentMillis - _fx.multi.lastswitch >=    // determines the length of the flash               
+    _fx.multi.durations[_fx.multi.activeindex])               // (different for each color)
     {
-    _LastMultiColorSwitch = CurrentMillis;     // store time of last color switch
-    if (_randsequence)
-       _ActiveColorIndex = random(0, _nrofcolors-1);
+    _fx.multi.lastswitch = CurrentMillis;     // store time of last color switch
+    if (_fx.multi.randsequence)
+       _fx.multi.activeindex = random(0, _fx.multi.nrofcolors-1);
     else
        {
-       _ActiveColorIndex++;                       // switch color
-       if (_ActiveColorIndex > _nrofcolors-1)     // handle overrun
-          _ActiveColorIndex = 0;
+       _fx.multi.activeindex++;                       // switch color
+       if (_fx.multi.activeindex > _fx.multi.nrofcolors-1)     // handle overrun
+          _fx.multi.activeindex = 0;
        }
     }
 
-LightStrip(_colors[_ActiveColorIndex]);
+LightStrip(_fx.multi.colors[_fx.multi.activeindex]);
 }
 
 void RGBStrip::SetupTwoColorFlash(int color1[3], int color2[3], 
-                                  int Col1Duration, int Col2Duration, int FlashDuration)
+                                  unsigned int Col1Duration, unsigned int Col2Duration, unsigned int FlashDuration)
 {
-CopyColor(_color1, color1);
-CopyColor(_color2, color2);
-_Col1Duration = Col1Duration;
-_Col2Duration = Col2Duration;
-_FlashDuration = FlashDuration;
-_Color1Active = true;
-_FlashStartTime = 0;
+UseEffect(PLS_EFFECT_TWOCOLORFLASH);
+CopyColor(_fx.two.color1, color1);
+CopyColor(_fx.two.color2, color2);
+_fx.two.col1duration = Col1Duration;
+_fx.two.col2duration = Col2Duration;
+_fx.two.duration = FlashDuration;
+_fx.two.color1active = true;
+_fx.two.starttime = 0;
 }
 
 void RGBStrip::TwoColorFlash(unsigned long CurrentMillis, boolean * FlashActive)
 {
+PLS_PROFILE_SCOPE(PROF_TWOCOLORFLASH);
+if (_effect != PLS_EFFECT_TWOCOLORFLASH)	// not set up or another effect was set up since
+  {
+  *FlashActive = false;
+  return;
+  }
 if (*FlashActive == false)   // signal detected for the first time
   {
-  _FlashStartTime = CurrentMillis;
-  _LastColorSwitch = CurrentMillis;
+  _fx.two.starttime = CurrentMillis;
+  _fx.two.lastswitch = CurrentMillis;
   *FlashActive = true;
   }
 else              // we want to make sure, that this lasts for a while to really see some effect
   {
-  if (CurrentMillis - _FlashStartTime > _FlashDuration)
+  if (CurrentMillis - _fx.two.starttime > _fx.two.duration)
     {
     *FlashActive = false;
     return;
     }
   }
   
-if (_Color1Active)
+if (_fx.two.color1active)
   {
-  if (CurrentMillis - _LastColorSwitch >= _Col1Duration)    // determines the length of the flash (different for                                                             // each color)
+  if (CurrentMillis - _fx.two.lastswitch >= _fx.two.col1duration)    // determines the length of the flash (different for                                                             // each color)
     {
-    _LastColorSwitch = CurrentMillis;
-    _Color1Active = false;                    // switch color
+    _fx.two.lastswitch = CurrentMillis;
+    _fx.two.color1active = false;                    // switch color
     }
   }
 else
   {
-  if (CurrentMillis - _LastColorSwitch >= _Col2Duration)    // determines the length of the flash (different for                                                             // each color)
+  if (CurrentMillis - _fx.two.lastswitch >= _fx.two.col2duration)    // determines the length of the flash (different for                                                             // each color)
     {
-    _LastColorSwitch = CurrentMillis;
-    _Color1Active = true;                    // switch color
+    _fx.two.lastswitch = CurrentMillis;
+    _fx.two.color1active = true;                    // switch color
     }
   }
 
-if (_Color1Active)
-  LightStrip(_color1);
+if (_fx.two.color1active)
+  LightStrip(_fx.two.color1);
 else
-  LightStrip(_color2);
+  LightStrip(_fx.two.color2);
 }
 
 // ============= functions for TwoColorFade ================
-void RGBStrip::SetupTwoColorFade(unsigned long fadecolorfrom, unsigned long fadecolorto, int fadestep, int fadespeed, int FadeDuration)
+void RGBStrip::SetupTwoColorFade(unsigned long fadecolorfrom, unsigned long fadecolorto, int fadestep, unsigned int fadespeed, unsigned int FadeDuration)
 {
 int coldiff[3];
 int i;
 
-Long2RGB(fadecolorfrom, _fadecolorfrom);
-Long2RGB(fadecolorto, _fadecolorto);
+UseEffect(PLS_EFFECT_TWOCOLORFADE);
 
-_fadespeed = fadespeed;   // the speed of the color change
-_FadeDuration = FadeDuration;
+Long2RGB(fadecolorfrom, _fx.fade.from);
+Long2RGB(fadecolorto, _fx.fade.to);
+
+_fx.fade.speed = fadespeed;   // the speed of the color change
+_fx.fade.duration = FadeDuration;
 
 if (fadestep < 1)
   fadestep = 1;
@@ -327,36 +760,36 @@ if (fadestep > 5)
 
 for (i=0; i<=2; i++)
   {
-  coldiff[i] = _fadecolorfrom[i] - _fadecolorto[i];
+  coldiff[i] = _fx.fade.from[i] - _fx.fade.to[i];
   if (coldiff[i] < 0)
-    _fadedir[i] = +1;
+    _fx.fade.dir[i] = +1;
   else
-    _fadedir[i] = -1;
+    _fx.fade.dir[i] = -1;
   coldiff[i] = abs(coldiff[i]);
   }
 
 if (coldiff[0] >= coldiff[1] && coldiff[0] >= coldiff[2])
   {
-  _fadestep[0] = 100 * fadestep;
-  _fadestep[1] = 100 * fadestep * coldiff[1]/coldiff[0];
-  _fadestep[2] = 100 * fadestep * coldiff[2]/coldiff[0];
+  _fx.fade.step[0] = 100 * fadestep;
+  _fx.fade.step[1] = 100 * fadestep * coldiff[1]/coldiff[0];
+  _fx.fade.step[2] = 100 * fadestep * coldiff[2]/coldiff[0];
   }
 else
   if (coldiff[1] >= coldiff[0] && coldiff[1] >= coldiff[2])
     {
-    _fadestep[1] = 100 * fadestep;
-    _fadestep[0] = 100 * fadestep * coldiff[0]/coldiff[1];
-    _fadestep[2] = 100 * fadestep * coldiff[2]/coldiff[1];
+    _fx.fade.step[1] = 100 * fadestep;
+    _fx.fade.step[0] = 100 * fadestep * coldiff[0]/coldiff[1];
+    _fx.fade.step[2] = 100 * fadestep * coldiff[2]/coldiff[1];
     }
   else
     {
-    _fadestep[2] = 100 * fadestep;
-    _fadestep[1] = 100 * fadestep * coldiff[1]/coldiff[2];
-    _fadestep[0] = 100 * fadestep * coldiff[0]/coldiff[2];
+    _fx.fade.step[2] = 100 * fadestep;
+    _fx.fade.step[1] = 100 * fadestep * coldiff[1]/coldiff[2];
+    _fx.fade.step[0] = 100 * fadestep * coldiff[0]/coldiff[2];
     }
 
 for (i=0; i<=2; i++)
-  _fadecolor[i] = _fadecolorfrom[i] * 100;
+  _fx.fade.color[i] = _fx.fade.from[i] * 100;
 }
 
 boolean RGBStrip::DetectColorLimit(int color, int fadecolorfrom, int fadecolorto, int colordir)
@@ -383,48 +816,152 @@ void RGBStrip::SwitchDir()
 int i;
 for (i=0; i<=2; i++)
   {
-  if (_fadedir[i] == +1)
-    _fadecolor[i] = max(_fadecolorfrom[i], _fadecolorto[i]) * 100;
+  if (_fx.fade.dir[i] == +1)
+    _fx.fade.color[i] = max(_fx.fade.from[i], _fx.fade.to[i]) * 100;
   else
-    _fadecolor[i] = min(_fadecolorfrom[i], _fadecolorto[i]) * 100;
-  _fadedir[i] = -_fadedir[i];
+    _fx.fade.color[i] = min(_fx.fade.from[i], _fx.fade.to[i]) * 100;
+  _fx.fade.dir[i] = -_fx.fade.dir[i];
   }
 }
 
 void RGBStrip::TwoColorFade(unsigned long CurrentMillis, boolean *FadeActive)
 {
+PLS_PROFILE_SCOPE(PROF_TWOCOLORFADE);
 int i;
 
+if (_effect != PLS_EFFECT_TWOCOLORFADE)	// not set up or another effect was set up since
+  {
+  *FadeActive = false;
+  return;
+  }
 if (*FadeActive == false)   // signal detected for the first time
   {
-  _FadeStartTime = CurrentMillis;
-  _LastFadeStep = CurrentMillis;
+  _fx.fade.starttime = CurrentMillis;
+  _fx.fade.laststep = CurrentMillis;
   *FadeActive = true;
   }
 else              // we want to make sure, that this lasts for a while to really see some effect
   {
-  if (CurrentMillis - _FadeStartTime > _FadeDuration)
+  if (CurrentMillis - _fx.fade.starttime > _fx.fade.duration)
     {
     *FadeActive = false;
     return;
     }
   }
 
-if (CurrentMillis - _LastFadeStep >= _fadespeed)    // determines the speed of the color change
+if (CurrentMillis - _fx.fade.laststep >= _fx.fade.speed)    // determines the speed of the color change
   {
-  _LastFadeStep = CurrentMillis;
+  _fx.fade.laststep = CurrentMillis;
   for (i=0; i<=2; i++)
-    _fadecolor[i] = _fadecolor[i] + _fadedir[i] * _fadestep[i];
+    _fx.fade.color[i] = _fx.fade.color[i] + _fx.fade.dir[i] * _fx.fade.step[i];
 
   // if one of the color components reaches the other end, all components are set to the other color
   // and we continue in the other direction
-  if ((DetectColorLimit(_fadecolor[0], _fadecolorfrom[0] * 100, _fadecolorto[0] * 100, _fadedir[0])) ||  
-      (DetectColorLimit(_fadecolor[1], _fadecolorfrom[1] * 100, _fadecolorto[1] * 100, _fadedir[1])) ||
-      (DetectColorLimit(_fadecolor[2], _fadecolorfrom[2] * 100, _fadecolorto[2] * 100, _fadedir[2])))
+  if ((DetectColorLimit(_fx.fade.color[0], _fx.fade.from[0] * 100, _fx.fade.to[0] * 100, _fx.fade.dir[0])) ||  
+      (DetectColorLimit(_fx.fade.color[1], _fx.fade.from[1] * 100, _fx.fade.to[1] * 100, _fx.fade.dir[1])) ||
+      (DetectColorLimit(_fx.fade.color[2], _fx.fade.from[2] * 100, _fx.fade.to[2] * 100, _fx.fade.dir[2])))
     SwitchDir();
   }
 
-LightStrip(_fadecolor[0]/100, _fadecolor[1]/100, _fadecolor[2]/100);
+LightStrip(_fx.fade.color[0]/100, _fx.fade.color[1]/100, _fx.fade.color[2]/100);
+}
+
+// ============= functions for Keyframes ================
+/* Keyframes plays a palette from flash (see PlsKeyframe). The colors between two
+   keyframes are blended with 8 bit weights; the progress in a segment is the
+   elapsed time multiplied by a step that is computed once per segment, so the
+   only division happens when a new segment starts.
+*/
+void RGBStrip::SetupKeyframes(const PlsKeyframe * keys, byte nrofkeys, byte mode, unsigned long Duration)
+{
+UseEffect(PLS_EFFECT_KEYFRAMES);
+_fx.key.keys = keys;
+_fx.key.nrofkeys = max(nrofkeys, (byte)1);
+_fx.key.mode = mode;
+_fx.key.duration = Duration;
+}
+
+// ----------- Function to load the segment from keyframe index to the next one --------
+void RGBStrip::StartSegment(byte index)
+{
+const PlsKeyframe * key;
+byte next = index;
+byte last = _fx.key.nrofkeys - 1;
+
+if (_fx.key.mode == PLS_KEY_PINGPONG && last > 0)
+  {
+  if ((_fx.key.dir > 0 && index == last) || (_fx.key.dir < 0 && index == 0))
+    _fx.key.dir = -_fx.key.dir;		// turn around
+  next = index + _fx.key.dir;
+  }
+else if (index < last)
+  next = index + 1;
+else if (_fx.key.mode == PLS_KEY_LOOP)
+  next = 0;
+// else PLS_KEY_ONCE: the last keyframe holds its color
+
+_fx.key.index = index;
+key = &_fx.key.keys[_fx.key.dir > 0 ? index : next];	// describes the way between both
+_fx.key.interp = pgm_read_byte(&key->interp);
+_fx.key.seglength = max(pgm_read_word(&key->duration), 1);
+_fx.key.step = 0xffffffffUL / _fx.key.seglength;
+_fx.key.from[0] = pgm_read_byte(&_fx.key.keys[index].red);
+_fx.key.from[1] = pgm_read_byte(&_fx.key.keys[index].green);
+_fx.key.from[2] = pgm_read_byte(&_fx.key.keys[index].blue);
+_fx.key.to[0] = pgm_read_byte(&_fx.key.keys[next].red);
+_fx.key.to[1] = pgm_read_byte(&_fx.key.keys[next].green);
+_fx.key.to[2] = pgm_read_byte(&_fx.key.keys[next].blue);
+}
+
+void RGBStrip::Keyframes(unsigned long CurrentMillis, boolean * KeyframesActive)
+{
+PLS_PROFILE_SCOPE(PROF_KEYFRAMES);
+unsigned long elapsed;
+unsigned int weight;
+byte i, color[3];
+
+if (_effect != PLS_EFFECT_KEYFRAMES)	// not set up or another effect was set up since
+  {
+  *KeyframesActive = false;
+  return;
+  }
+if (*KeyframesActive == false)   // called for the first time
+  {
+  _fx.key.starttime = CurrentMillis;
+  _fx.key.segstart = CurrentMillis;
+  _fx.key.dir = +1;
+  StartSegment(0);
+  *KeyframesActive = true;
+  }
+else if (_fx.key.duration && CurrentMillis - _fx.key.starttime > _fx.key.duration)
+  {
+  *KeyframesActive = false;
+  return;
+  }
+
+// go on to the segment CurrentMillis is in (more than one if calls were missed)
+while (CurrentMillis - _fx.key.segstart >= _fx.key.seglength)
+  {
+  if (_fx.key.mode == PLS_KEY_ONCE && _fx.key.index == _fx.key.nrofkeys - 1)
+    {
+    *KeyframesActive = false;		// the last keyframe was held long enough
+    return;
+    }
+  _fx.key.segstart += _fx.key.seglength;
+  StartSegment(_fx.key.mode == PLS_KEY_PINGPONG && _fx.key.nrofkeys > 1 ?
+               _fx.key.index + _fx.key.dir :
+               (_fx.key.index + 1) % _fx.key.nrofkeys);
+  }
+
+elapsed = CurrentMillis - _fx.key.segstart;
+weight = (elapsed * _fx.key.step) >> 24;	// progress in the segment, 0..255
+if (_fx.key.interp == PLS_KEY_HARDCUT)
+  weight = 0;
+else if (_fx.key.interp == PLS_KEY_EASE)	// smoothstep 3w^2 - 2w^3
+  weight = ((unsigned long)weight * weight * (768 - 2 * weight)) >> 16;
+for (i=0; i<=2; i++)
+  color[i] = ((unsigned int)_fx.key.from[i] * (256 - weight) + (unsigned int)_fx.key.to[i] * weight) >> 8;
+LightStrip(color[0], color[1], color[2]);
 }
 
 // --------- end of implementation of class RGBStrip ---------
@@ -442,24 +979,43 @@ pinMode(pin, OUTPUT);
 _pin = pin;
 _delaytime = 0;
 _starttime = 0;
+_flashval = 0;
+_flashlength = 0;
+_flashphases = 0;		// no flashes set up, Flashes() ends at once
+_flashphase = 0;
+_LastFlashToggle = 0;
+_lastduty = -1;		// nothing written yet, so the first write always happens
+ResetWriteCounters();
 
 Output(0);	// initially switch it off
 }
 
-// Function to send a signal to that device
+// Function to send a signal to that device (the pin is only written if the value changed)
 void Std12VOutput::Output(int val)
 {
+PLS_PROFILE_SCOPE(PROF_OUTPUT);
 val = constrain(val, 0, 255);
-analogWrite(_pin, val);
+if (WriteDuty(_pin, &_lastduty, val))
+  _writesissued++;
+else
+  _writesskipped++;
 }
 
 /* Function to light an LED strip or an LED or shake a shaker motor
    for a specified time without using the delay() function
 */
-void Std12VOutput::OutputWithDelay(int val, int delaytime, unsigned long CurrentMillis, boolean *OutputActive)
+void Std12VOutput::OutputWithDelay(int val, unsigned int delaytime, unsigned long CurrentMillis, boolean *OutputActive)
 {
+PLS_PROFILE_SCOPE(PROF_OUTPUTWITHDELAY);
 val = constrain(val, 0, 255);
-if (_delaytime = 0)	// set initially and at the end of delayed 
+if (delaytime == 0)	// no time at all ==> off now
+  {
+  Output(0);
+  ResetDelay();
+  *OutputActive = false;
+  return;
+  }
+if (_delaytime == 0)	// set initially and at the end of delayed 
   {
   _delaytime = delaytime;
   _starttime = CurrentMillis;
@@ -467,8 +1023,7 @@ if (_delaytime = 0)	// set initially and at the end of delayed
 if (CurrentMillis - _starttime > _delaytime)
   {
   Output(0);	// time over ==> switch off
-  _delaytime = 0;
-  _starttime = 0;
+  ResetDelay();
   *OutputActive = false;
   }
 else
@@ -478,6 +1033,13 @@ else
   }
 }
 
+// Function to end a running OutputWithDelay, the next call starts a new delay
+void Std12VOutput::ResetDelay()
+{
+_delaytime = 0;
+_starttime = 0;
+}
+
 // Function to flash the Strip a certain number of times with a certain length
 void Std12VOutput::MakeFlashes(int val, int flashes, int flashlength) 
 {
@@ -495,93 +1057,571 @@ for (i=1; i<=flashes; i++)
   }
 }
 
-// --------- end of implementation of class Std12VOutput ---------
-// ===============================================================
-
+// Function to flash the device without using delay(), works like RGBStrip::Flashes
+void Std12VOutput::SetupFlashes(int val, int flashes, unsigned int flashlength)
+{
+_flashval = val;
+_flashlength = flashlength;
+flashes = constrain(flashes, 1, 127);
+_flashphases = flashes*2 - 1;	// no off phase after the last flash
+_flashphase = 0;
+}
 
-// ===============================================================
-// Implementation of class Switch
+void Std12VOutput::Flashes(unsigned long CurrentMillis, boolean * FlashActive)
+{
+PLS_PROFILE_SCOPE(PROF_OUTPUTFLASHES);
+if (_flashphases == 0)	// SetupFlashes was not called
+  {
+  *FlashActive = false;
+  return;
+  }
+if (*FlashActive == false)   // called for the first time
+  {
+  _LastFlashToggle = CurrentMillis;
+  _flashphase = 0;
+  *FlashActive = true;
+  }
+else if (CurrentMillis - _LastFlashToggle >= _flashlength)
+  {
+  _LastFlashToggle = CurrentMillis;
+  _flashphase++;
+  if (_flashphase >= _flashphases)	// last flash is over
+    {
+    *FlashActive = false;
+    return;
+    }
+  }
 
-// -----------  Constructor for Switch --------------
+if (_flashphase & 1)	// odd phases are the pauses between the flashes
+  Output(0);
+else
+  Output(_flashval);
+}
 
-Switch::Switch(int pin, int switchwait)
+// ------------ Functions to check how many PWM writes were saved ---------
+unsigned long Std12VOutput::GetWritesIssued()
 {
-pinMode(pin, INPUT);
-_pin = pin;
-_switchwait = switchwait; // how long do we wait in method ReadSwitchDelayed until we 
-                          // return true (this is for switches like in the ball trough 
-			  // where the ball rolls through and does not stay in that place)
-_closetime = 0;
+return _writesissued;
 }
 
-// ------------ Function to read the switch -------------
-
-boolean Switch::ReadSwitch()
+unsigned long Std12VOutput::GetWritesSkipped()
 {
-return digitalRead(_pin);  // returns true for a closed switch and false for an open one
+return _writesskipped;
 }
 
-// Function to read a switch but only return true if it was closed for a certain time
-// This function is used e.g. for switches in the ball trough where we only want to
-// report "switch closed" when the ball stays there for a while
+void Std12VOutput::ResetWriteCounters()
+{
+_writesissued = 0;
+_writesskipped = 0;
+}
 
-boolean Switch::ReadSwitchDelayed(unsigned long CurrentMillis)
+// Function to drive the output with BAMOutput, so it also works on pins without
+// hardware PWM. The output is off until the next Output call.
+boolean Std12VOutput::UseBAM()
 {
-if (digitalRead(_pin) == HIGH)  // switch closed
-  {
-  if (_closetime == 0)		 // switch was open before
-    _closetime = CurrentMillis;  // remember when switch was closed
-  if (CurrentMillis - _closetime > _switchwait)  // was it closed long enough?
-    {
-    _closetime = 0;
-    return true;    // switch was closed long enough to assume that the ball remains there
-    }
-  else
-    return false;   // not yet closed long enough
-  }
-else
-  {
-  _closetime = 0;
+if (!BAMOutput::Attach(_pin))
   return false;
-  }
+_lastduty = -1;		// the value has to be written to the bit planes
+return true;
 }
 
-// --------- end of implementation of class Switch ---------
+// --------- end of implementation of class Std12VOutput ---------
 // ===============================================================
 
-// ===============================================================
-// Implementation of class OptoSwitch
 
-// -----------  Constructor for OptoSwitch --------------
+// ===============================================================
+// Implementation of class BAMOutput
+
+volatile uint8_t * BAMOutput::_portreg[PLS_MAX_BAM_PORTS];
+byte BAMOutput::_portmask[PLS_MAX_BAM_PORTS];
+byte BAMOutput::_planes[8][PLS_MAX_BAM_PORTS];
+byte BAMOutput::_nrofports = 0;
+byte BAMOutput::_pinport[NUM_DIGITAL_PINS];
+byte BAMOutput::_bit = 0;
+unsigned int BAMOutput::_tick = PLS_BAM_MIN_TICK;
+
+// the hook of WriteDuty: writes the pin into the bit planes if it is attached
+static boolean WriteBAM(int pin, byte duty)
+{
+if (!BAMOutput::Attached(pin))
+  return false;
+BAMOutput::Write(pin, duty);
+return true;
+}
 
-OptoSwitch::OptoSwitch(int pin, int switchwait)
+// ------------ Function to hand a pin over to the bit planes (the pin starts LOW) -------------
+boolean BAMOutput::Attach(int pin)
 {
-pinMode(pin, INPUT);
-_pin = pin;
-_switchwait = switchwait; // how long do we wait in method ReadSwitchDelayed until we 
-                          // return true (this is for switches like in the ball trough 
-			  // where the ball rolls through and does not stay in that place
-_closetime = 0;
+volatile uint8_t * reg;
+byte port, i;
+
+if (pin < 0 || pin >= NUM_DIGITAL_PINS)
+  return false;
+if (_pinport[pin])		// already attached
+  return true;
+port = digitalPinToPort(pin);
+if (port == NOT_A_PIN)
+  return false;
+reg = portOutputRegister(port);
+for (i=0; i<_nrofports; i++)
+  if (_portreg[i] == reg)
+    break;
+if (i == _nrofports)		// first pin of this port
+  {
+  if (_nrofports >= PLS_MAX_BAM_PORTS)
+    return false;
+  _portreg[i] = reg;
+  _portmask[i] = 0;
+  _nrofports = i + 1;		// the interrupt may use this port from now on
+  }
+pinMode(pin, OUTPUT);
+digitalWrite(pin, LOW);		// also switches a hardware PWM of the pin off
+_portmask[i] |= digitalPinToBitMask(pin);	// all planes are 0 for this pin, so it stays LOW
+_pinport[pin] = i + 1;
+_bamwrite = WriteBAM;		// LightStrip and Output write the planes from now on
+return true;
 }
 
-// Function to read an opto switch (returns true when the switch is open)
-boolean OptoSwitch::ReadSwitch()
+boolean BAMOutput::Attached(int pin)
 {
-return !digitalRead(_pin);  // returns true for an open switch and false for a closed one
+return pin >= 0 && pin < NUM_DIGITAL_PINS && _pinport[pin] != 0;
 }
 
-// Function to read an opto switch but only return true if it was open for a certain time
-// This function is used e.g. for switches in the ball trough where we only want to
-// report "switch closed" when the ball stays there for a while
-boolean OptoSwitch::ReadSwitchDelayed(unsigned long CurrentMillis)
+// ------------ Function to put a duty value into the bit planes -------------
+// The interrupt only reads the planes, so no interrupts need to be disabled; a
+// value changed in the middle of a refresh cycle is complete in the next one.
+void BAMOutput::Write(int pin, byte duty)
 {
-if (digitalRead(_pin) == LOW)  // switch open (usually means "ball present")
+byte port, mask, bit;
+
+if (!Attached(pin))
+  return;
+port = _pinport[pin] - 1;
+mask = digitalPinToBitMask(pin);
+for (bit=0; bit<8; bit++, duty >>= 1)
+  {
+  if (duty & 1)
+    _planes[bit][port] |= mask;
+  else
+    _planes[bit][port] &= ~mask;
+  }
+}
+
+// ------------ Function to start timer 1 (CTC mode, 0.5 us per tick) -------------
+void BAMOutput::Start(unsigned int refreshrate)
+{
+unsigned long tick;
+
+if (refreshrate == 0)
+  refreshrate = 1;
+tick = F_CPU / 8 / 255 / refreshrate;	// the only division, once at start
+_tick = constrain(tick, (unsigned long)PLS_BAM_MIN_TICK, 511UL);	// plane 7 has to fit into 16 bits
+_bit = 0;
+#if defined(TCCR1A) && defined(OCIE1A)
+noInterrupts();
+TCCR1A = 0;
+TCCR1B = _BV(WGM12) | _BV(CS11);	// CTC with OCR1A as top, prescaler 8
+TCNT1 = 0;
+OCR1A = _tick - 1;
+TIFR1 = _BV(OCF1A);
+TIMSK1 |= _BV(OCIE1A);
+interrupts();
+#endif
+}
+
+void BAMOutput::Stop()
+{
+byte i;
+
+#if defined(TIMSK1) && defined(OCIE1A)
+TIMSK1 &= ~_BV(OCIE1A);
+#endif
+for (i=0; i<_nrofports; i++)	// all BAM pins LOW
+  *_portreg[i] &= ~_portmask[i];
+}
+
+// ------------ Interrupt routine: show the next bit plane -------------
+// Writes every used port once and sets the timer to the length of the plane.
+// Other pins of the ports are kept, so they can still be used with digitalWrite.
+void BAMOutput::HandleInterrupt()
+{
+volatile uint8_t * reg;
+byte bit = _bit;
+byte i;
+
+for (i=0; i<_nrofports; i++)
+  {
+  reg = _portreg[i];
+  *reg = (*reg & ~_portmask[i]) | _planes[bit][i];
+  }
+#if defined(OCR1A)
+OCR1A = (_tick << bit) - 1;	// plane n is shown for 2^n ticks
+#endif
+_bit = (bit + 1) & 7;
+}
+
+// --------- end of implementation of class BAMOutput ---------
+// ===============================================================
+
+
+// ===============================================================
+// Implementation of class AddressableStrip
+
+// -----------  Constructor for AddressableStrip --------------
+
+AddressableStrip::AddressableStrip(int pin, byte * buffer, unsigned int nrofpixels)
+{
+pinMode(pin, OUTPUT);
+digitalWrite(pin, LOW);
+_port = portOutputRegister(digitalPinToPort(pin));
+_mask = digitalPinToBitMask(pin);
+_buffer = buffer;
+_nrofpixels = nrofpixels;
+memset(_buffer, 0, nrofpixels * 3);
+_dirty = nrofpixels;		// the first Show() switches all pixels off
+_lastshow = micros() - PLS_WS2812_LATCH_US;
+_pixelssent = 0;
+}
+
+// ------------ Functions to change the frame buffer -------------
+// a pixel only counts as changed if its color is different
+void AddressableStrip::SetPixel(unsigned int index, byte red, byte green, byte blue)
+{
+byte * p;
+
+if (index >= _nrofpixels)
+  return;
+p = &_buffer[index * 3];
+if (p[0] == green && p[1] == red && p[2] == blue)
+  return;
+p[0] = green;
+p[1] = red;
+p[2] = blue;
+if (index >= _dirty)
+  _dirty = index + 1;
+}
+
+void AddressableStrip::SetPixel(unsigned int index, unsigned long color)
+{
+SetPixel(index, GetRed(color), GetGreen(color), GetBlue(color));
+}
+
+unsigned long AddressableStrip::GetPixel(unsigned int index)
+{
+if (index >= _nrofpixels)
+  return 0;
+return RGB2Long(_buffer[index * 3 + 1], _buffer[index * 3], _buffer[index * 3 + 2]);
+}
+
+void AddressableStrip::Fill(unsigned int first, unsigned int count, byte red, byte green, byte blue)
+{
+unsigned int i;
+
+for (i=0; i<count; i++)
+  SetPixel(first + i, red, green, blue);
+}
+
+void AddressableStrip::Clear()
+{
+Fill(0, _nrofpixels, 0, 0, 0);
+}
+
+// ------------ Function to send the changed part of the frame buffer -------------
+boolean AddressableStrip::Show()
+{
+if (_dirty == 0 || micros() - _lastshow < PLS_WS2812_LATCH_US)
+  return false;
+noInterrupts();			// a pause of a few us in the middle would latch the pixels
+Send(_port, _mask, _buffer, _dirty * 3);
+interrupts();
+_lastshow = micros();
+_pixelssent += _dirty;
+_dirty = 0;
+return true;
+}
+
+unsigned int AddressableStrip::GetNrOfPixels()
+{
+return _nrofpixels;
+}
+
+unsigned long AddressableStrip::GetPixelsSent()
+{
+return _pixelssent;
+}
+
+/* Sends the bytes, MSB first. Every bit takes 20 cycles at 16 MHz (1.25 us), the
+   line is high for 5 cycles (312 ns) for a 0 and for 12 cycles (750 ns) for a 1.
+   The sbrs takes one cycle less than sbrs + st, so a 0 bit takes 21 cycles, and
+   the last bit of a byte is 8 cycles longer (low), both well within the timing
+   the pixels accept. Nothing is sent on other boards and on the PC. */
+void AddressableStrip::Send(volatile uint8_t * port, byte mask, const byte * data, unsigned int nrofbytes)
+{
+#if defined(__AVR__) && (F_CPU == 16000000UL)
+byte hi, lo, b, bit = 8;
+
+if (nrofbytes == 0)
+  return;
+hi = *port | mask;
+lo = *port & ~mask;
+b = *data++;
+__asm__ __volatile__(
+  "1:\n\t"
+  "st   %a[port], %[hi]\n\t"	// 2  line high
+  "rjmp .+0\n\t"		// 2
+  "sbrs %[b], 7\n\t"		// 1  (2 and skip the st if the bit is 1)
+  "st   %a[port], %[lo]\n\t"	// 2  0 bit: low after 5 cycles
+  "lsl  %[b]\n\t"		// 1
+  "dec  %[bit]\n\t"		// 1
+  "rjmp .+0\n\t"		// 2
+  "rjmp .+0\n\t"		// 2
+  "st   %a[port], %[lo]\n\t"	// 2  1 bit: low after 12 cycles
+  "rjmp .+0\n\t"		// 2
+  "rjmp .+0\n\t"		// 2
+  "brne 1b\n\t"			// 2  next bit
+  "sbiw %[count], 1\n\t"	// 2  next byte
+  "breq 2f\n\t"			// 1
+  "ld   %[b], %a[data]+\n\t"	// 2
+  "ldi  %[bit], 8\n\t"		// 1
+  "rjmp 1b\n"			// 2
+  "2:\n"
+  : [b] "+r" (b), [bit] "+d" (bit), [count] "+w" (nrofbytes), [data] "+e" (data)
+  : [port] "e" (port), [hi] "r" (hi), [lo] "r" (lo)
+  : "memory");
+#else
+(void)port;
+(void)mask;
+(void)data;
+(void)nrofbytes;
+#endif
+}
+
+// --------- end of implementation of class AddressableStrip ---------
+// ===============================================================
+
+
+// ===============================================================
+// Implementation of class SwitchBank
+
+// -----------  Constructor for SwitchBank --------------
+
+SwitchBank::SwitchBank()
+{
+_nrofports = 0;
+_nrofinputs = 0;
+_invert = 0;
+_state = 0;
+}
+
+// ------------ Function to register an input -------------
+// inverted inputs (e.g. optos) are reported as true when the pin is LOW
+byte SwitchBank::AddInput(int pin, boolean inverted)
+{
+volatile uint8_t * reg;
+byte port, i;
+
+if (_nrofinputs >= PLS_MAX_BANK_INPUTS)
+  return PLS_NO_INPUT;
+port = digitalPinToPort(pin);
+if (port == NOT_A_PIN)
+  return PLS_NO_INPUT;
+reg = portInputRegister(port);
+
+for (i=0; i<_nrofports; i++)	// is this port already read by the bank?
+  if (_portreg[i] == reg)
+    break;
+if (i == _nrofports)
+  {
+  if (_nrofports >= PLS_MAX_BANK_PORTS)
+    return PLS_NO_INPUT;
+  _portreg[i] = reg;
+  _portstate[i] = *reg;
+  _nrofports++;
+  }
+
+_inputport[_nrofinputs] = i;
+_inputmask[_nrofinputs] = digitalPinToBitMask(pin);
+if (inverted)
+  {
+  _inputport[_nrofinputs] |= 0x80;
+  _invert |= 1UL << _nrofinputs;
+  }
+return _nrofinputs++;
+}
+
+// ------------ Function to take a new snapshot of all inputs -------------
+void SwitchBank::Update()
+{
+PLS_PROFILE_SCOPE(PROF_SWITCHBANKUPDATE);
+unsigned long state = 0;
+unsigned long bit = 1;
+byte i;
+
+for (i=0; i<_nrofports; i++)	// one read per port
+  _portstate[i] = *_portreg[i];
+
+for (i=0; i<_nrofinputs; i++, bit <<= 1)
+  if (_portstate[_inputport[i] & 0x7f] & _inputmask[i])
+    state |= bit;
+_state = state ^ _invert;
+}
+
+boolean SwitchBank::Read(byte id)
+{
+byte port;
+boolean level;
+
+if (id >= _nrofinputs)
+  return false;
+port = _inputport[id];
+level = (_portstate[port & 0x7f] & _inputmask[id]) != 0;
+if (port & 0x80)	// inverted input
+  return !level;
+return level;
+}
+
+unsigned long SwitchBank::GetState()
+{
+return _state;
+}
+
+byte SwitchBank::GetNrOfInputs()
+{
+return _nrofinputs;
+}
+
+// --------- end of implementation of class SwitchBank ---------
+// ===============================================================
+
+
+// ===============================================================
+// Implementation of class Switch
+
+// -----------  Constructor for Switch --------------
+
+Switch::Switch(int pin, unsigned int switchwait)
+{
+pinMode(pin, INPUT);
+_pin = pin;
+_switchwait = switchwait; // how long do we wait in method ReadSwitchDelayed until we 
+                          // return true (this is for switches like in the ball trough 
+			  // where the ball rolls through and does not stay in that place)
+_closetime = 0;
+_closed = false;
+_bank = 0;
+}
+
+// ------------ Function to read the switch -------------
+
+boolean Switch::ReadSwitch()
+{
+PLS_PROFILE_SCOPE(PROF_READSWITCH);
+if (_bank)
+  return _bank->Read(_bankid);
+return digitalRead(_pin);  // returns true for a closed switch and false for an open one
+}
+
+// Function to read the switch from the snapshot of a SwitchBank instead of digitalRead()
+// (if the bank is full the switch keeps using digitalRead())
+byte Switch::UseSwitchBank(SwitchBank * bank)
+{
+byte id = bank->AddInput(_pin);
+
+if (id != PLS_NO_INPUT)
+  {
+  _bank = bank;
+  _bankid = id;
+  }
+return id;
+}
+
+// Function to read a switch but only return true if it was closed for a certain time
+// This function is used e.g. for switches in the ball trough where we only want to
+// report "switch closed" when the ball stays there for a while
+
+boolean Switch::ReadSwitchDelayed(unsigned long CurrentMillis)
+{
+PLS_PROFILE_SCOPE(PROF_READSWITCHDELAYED);
+if (ReadSwitch())  // switch closed
+  {
+  if (!_closed)		 // switch was open before
+    {
+    _closed = true;
+    _closetime = CurrentMillis;  // remember when switch was closed
+    }
+  if (CurrentMillis - _closetime > _switchwait)  // was it closed long enough?
+    {
+    _closed = false;
+    return true;    // switch was closed long enough to assume that the ball remains there
+    }
+  else
+    return false;   // not yet closed long enough
+  }
+else
+  {
+  _closed = false;
+  return false;
+  }
+}
+
+// --------- end of implementation of class Switch ---------
+// ===============================================================
+
+// ===============================================================
+// Implementation of class OptoSwitch
+
+// -----------  Constructor for OptoSwitch --------------
+
+OptoSwitch::OptoSwitch(int pin, unsigned int switchwait)
+{
+pinMode(pin, INPUT);
+_pin = pin;
+_switchwait = switchwait; // how long do we wait in method ReadSwitchDelayed until we 
+                          // return true (this is for switches like in the ball trough 
+			  // where the ball rolls through and does not stay in that place
+_closetime = 0;
+_closed = false;
+_bank = 0;
+}
+
+// Function to read an opto switch (returns true when the switch is open)
+boolean OptoSwitch::ReadSwitch()
+{
+PLS_PROFILE_SCOPE(PROF_OPTOREADSWITCH);
+if (_bank)
+  return _bank->Read(_bankid);
+return !digitalRead(_pin);  // returns true for an open switch and false for a closed one
+}
+
+// Function to read the opto from the snapshot of a SwitchBank, the bank does the inversion
+byte OptoSwitch::UseSwitchBank(SwitchBank * bank)
+{
+byte id = bank->AddInput(_pin, true);
+
+if (id != PLS_NO_INPUT)
+  {
+  _bank = bank;
+  _bankid = id;
+  }
+return id;
+}
+
+// Function to read an opto switch but only return true if it was open for a certain time
+// This function is used e.g. for switches in the ball trough where we only want to
+// report "switch closed" when the ball stays there for a while
+boolean OptoSwitch::ReadSwitchDelayed(unsigned long CurrentMillis)
+{
+PLS_PROFILE_SCOPE(PROF_OPTOREADSWITCHDELAYED);
+if (ReadSwitch())  // switch open (usually means "ball present")
   {
-  if (_closetime == 0)		 // switch was open before
+  if (!_closed)		 // switch was open before
+    {
+    _closed = true;
     _closetime = CurrentMillis;  // remember when switch was closed
+    }
   if (CurrentMillis - _closetime > _switchwait)  // was it closed long enough?
     {
-    _closetime = 0;
+    _closed = false;
     return true;    // switch was closed long enough to assume that the ball remains there
     }
   else
@@ -589,7 +1629,7 @@ if (digitalRead(_pin) == LOW)  // switch open (usually means "ball present")
   }
 else
   {
-  _closetime = 0;
+  _closed = false;
   return false;
   }
 }
@@ -614,8 +1654,12 @@ else
                     insert is still flashing.
 */ 
 
+// Only EnableEdgeCapture refers to InsertCapture, so a sketch that never calls it
+// does not link the edge buffer and the other statics of InsertCapture (~230 bytes of RAM)
+void (*Insert::_processedges)() = 0;
+
 // -----------  Constructor for Insert --------------
-Insert::Insert(int pin, int FilterDelay, int InsertOnDelay, int InsertOffDelay)
+Insert::Insert(int pin, unsigned int FilterDelay, unsigned int InsertOnDelay, unsigned int InsertOffDelay)
 {
 pinMode(pin, INPUT);
 _pin = pin;
@@ -625,21 +1669,150 @@ _insertoffdelay = InsertOffDelay;
 _lastinserton = 0;
 _lastinsertoff = 0;
 _state = 0;
+_bank = 0;
+_capture = false;
+_capturedlevel = false;
+_adaptive = false;
+_lastlevel = false;
+_strobeperiod = 0;
+_blinkperiod = 0;
+_lastrise = 0UL - PLS_MAX_BLINK_PERIOD - 1;	// the first rising edge starts over
+_lastblinkstart = 0;
+}
+
+// Function to switch the Insert to interrupt driven edge capture (see InsertCapture)
+byte Insert::EnableEdgeCapture()
+{
+byte id = InsertCapture::Attach(this);
+
+if (id != PLS_NO_INPUT)
+  {
+  _processedges = InsertCapture::Process;
+  _capture = true;
+  }
+return id;
+}
+
+// called by InsertCapture::Process for every captured edge of this Insert
+void Insert::HandleEdge(boolean level, unsigned long time)
+{
+_capturedlevel = level;
+_lastinserton = time;	// rising edge: lamp on now, falling edge: lamp was on until now
+if (level)
+  MeasureRisingEdge(time);
+}
+
+/* ----------- Blink period estimator --------
+   Every rising edge of the pin is either the next pulse of the lamp matrix (gap up
+   to PLS_MAX_STROBE_PERIOD, gives the strobe period) or the start of the next ON phase of a blinking
+   Insert (long gap, the time since the last ON phase started gives the blink period).
+   Both are averaged (3/4 old + 1/4 new value). With adaptive delays the filter delay
+   becomes 1.5 strobe periods and the on/off delays one blink period, so
+   GetBlinkInsertState settles within about one blink period.
+*/
+void Insert::SetAdaptiveDelays(boolean adaptive)
+{
+_adaptive = adaptive;
+}
+
+void Insert::MeasureRisingEdge(unsigned long time)
+{
+unsigned long gap = time - _lastrise;
+
+_lastrise = time;
+if (gap > PLS_MAX_BLINK_PERIOD)	// Insert was off for a long time, start over
+  {
+  _lastblinkstart = time;
+  return;
+  }
+if (gap <= PLS_MAX_STROBE_PERIOD)	// next pulse of the lamp matrix
+  {
+  if (_strobeperiod == 0)
+    _strobeperiod = gap;
+  else
+    _strobeperiod = _strobeperiod - (_strobeperiod >> 2) + (gap >> 2);
+  if (_adaptive)
+    _filterdelay = _strobeperiod + (_strobeperiod >> 1) + 1;
+  return;
+  }
+
+gap = time - _lastblinkstart;	// a new ON phase of a blinking Insert
+_lastblinkstart = time;
+if (gap > PLS_MAX_BLINK_PERIOD || (_blinkperiod != 0 && gap > 2 * (unsigned long)_blinkperiod))
+  return;			// a pause, not a blink
+if (_blinkperiod == 0)
+  _blinkperiod = gap;
+else
+  _blinkperiod = _blinkperiod - (_blinkperiod >> 2) + (gap >> 2);
+if (_adaptive)
+  {
+  _insertondelay = _blinkperiod;
+  _insertoffdelay = _blinkperiod;
+  }
+}
+
+unsigned int Insert::GetStrobePeriod()
+{
+return _strobeperiod;
+}
+
+unsigned int Insert::GetBlinkPeriod()
+{
+return _blinkperiod;
+}
+
+unsigned int Insert::GetBlinkFrequency()
+{
+if (_blinkperiod == 0)
+  return 0;
+return 1000000UL / _blinkperiod;
+}
+
+// Function to read the Insert from the snapshot of a SwitchBank instead of digitalRead()
+byte Insert::UseSwitchBank(SwitchBank * bank)
+{
+byte id = bank->AddInput(_pin);
+
+if (id != PLS_NO_INPUT)
+  {
+  _bank = bank;
+  _bankid = id;
+  }
+return id;
+}
+
+boolean Insert::ReadPin()
+{
+if (_capture)
+  {
+  _processedges();	// catch up with the edges seen by the interrupt
+  return _capturedlevel;
+  }
+if (_bank)
+  return _bank->Read(_bankid);
+return digitalRead(_pin);
 }
 
 // ----------- Function to read Inserts that are only ON or OFF ----------
 boolean Insert::InsertOn(unsigned long CurrentMillis)
 {
+PLS_PROFILE_SCOPE(PROF_INSERTON);
 boolean inserton;
+boolean level = ReadPin();
 
-if (digitalRead(_pin) == HIGH) 		// raising edge detected ==> Insert is ON
+if (level && !_lastlevel && !_capture)	// polling: measure the rising edges here
+  MeasureRisingEdge(CurrentMillis);
+_lastlevel = level;
+
+if (level == HIGH) 		// raising edge detected ==> Insert is ON
   {
   inserton = true;	
   _lastinserton = CurrentMillis;	// remember time of last HIGH
   }
 else
   {
-  if (CurrentMillis - _lastinserton > _filterdelay)	// no new HIGH for some time ==> Insert OFF again
+  // signed, because a captured edge can be a bit newer than CurrentMillis
+  if ((long)(CurrentMillis - _lastinserton) > (long)_filterdelay)	// no new HIGH for some time ==> Insert OFF again
     {
     inserton = false;
     _lastinsertoff = CurrentMillis;	// remember time of last LOW
@@ -659,6 +1832,9 @@ return inserton;
 */
 byte Insert::GetBlinkInsertState(unsigned long CurrentMillis)
 {
+PLS_PROFILE_SCOPE(PROF_GETBLINKINSERTSTATE);
+if (_adaptive)
+  return GetAdaptiveState(CurrentMillis, InsertOn(CurrentMillis));
 if (InsertOn(CurrentMillis) == false)	// Insert is OFF
   {
   if (_state == 0)	// is already in OFF state
@@ -704,26 +1880,1583 @@ else						// Insert is ON
      return _state;
      }
   }
+return _state;
+}
+
+/* ----------- State machine for adaptive delays --------
+   UNDEFINED is left as soon as the Insert shows what it does: ON if it stays on for
+   longer than one blink period, FLASHING if it goes off again before that, and a
+   FLASHING Insert is OFF once it stayed off for longer than one blink period.
+*/
+byte Insert::GetAdaptiveState(unsigned long CurrentMillis, boolean inserton)
+{
+if (inserton)
+  {
+  if (_state == 0)	// pos. edge, could be ON or FLASHING
+    _state = 3;
+  else if ((_state == 2 || _state == 3) && CurrentMillis - _lastinsertoff > _insertondelay)
+    _state = 1;		// on for longer than an ON phase of blinking
+  }
+else
+  {
+  if (_state == 1)	// neg. edge of a steady Insert
+    _state = 0;
+  else if (_state == 3)	// went off again ==> blinking
+    _state = 2;
+  else if (_state == 2 && CurrentMillis - _lastinserton > _insertoffdelay)
+    _state = 0;		// off for longer than an OFF phase of blinking
+  }
+return _state;
 }
 
 
 // --------- end of implementation of class Insert ---------
 // ===============================================================
 
+
 // ===============================================================
-// Implementation of class StdInput
+// Implementation of class InsertCapture
 
-// -----------  Constructor for StdInput --------------
+Insert * InsertCapture::_inserts[PLS_MAX_CAPTURED_INSERTS];
+volatile uint8_t * InsertCapture::_portreg[PLS_MAX_CAPTURED_INSERTS];
+byte InsertCapture::_mask[PLS_MAX_CAPTURED_INSERTS];
+byte InsertCapture::_levels = 0;
+byte InsertCapture::_nrofinserts = 0;
+PlsRingBuffer<InsertEdge, PLS_EDGE_BUFFER_SIZE> InsertCapture::_edges;
 
-StdInput::StdInput(int pin)
+// ------------ Function to register an Insert and enable the interrupt of its pin -------------
+byte InsertCapture::Attach(Insert * insert)
 {
-pinMode(pin, INPUT);
-_pin = pin;
+int pin = insert->_pin;
+byte port, id;
+
+if (_nrofinserts >= PLS_MAX_CAPTURED_INSERTS)
+  return PLS_NO_INPUT;
+port = digitalPinToPort(pin);
+if (port == NOT_A_PIN)
+  return PLS_NO_INPUT;
+#if defined(PCICR)
+if (digitalPinToPCICR(pin) == 0)	// pin has no pin change interrupt
+  return PLS_NO_INPUT;
+#endif
+
+id = _nrofinserts;
+_inserts[id] = insert;
+_portreg[id] = portInputRegister(port);
+_mask[id] = digitalPinToBitMask(pin);
+noInterrupts();			// _levels is also changed by the interrupt routine
+if (*_portreg[id] & _mask[id])
+  _levels |= 1 << id;
+insert->_capturedlevel = (_levels >> id) & 1;
+_nrofinserts = id + 1;		// the interrupt may look at this Insert from now on
+interrupts();
+
+#if defined(PCICR)
+*digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+*digitalPinToPCICR(pin) |= _BV(digitalPinToPCICRbit(pin));
+#endif
+return id;
 }
 
-// ------------ Function to read the switch -------------
+// ------------ Interrupt routine: find the Inserts that changed and store their edges -------------
+// One pin change interrupt covers a whole port, so every registered Insert is checked;
+// that costs a few cycles per Insert.
+void InsertCapture::HandleInterrupt()
+{
+InsertEdge edge;
+byte i, bit, level;
 
-boolean StdInput::ReadInput()
+edge.time = millis();	// safe here, interrupts are disabled in an interrupt routine
+for (i=0, bit=1; i<_nrofinserts; i++, bit <<= 1)
+  {
+  level = (*_portreg[i] & _mask[i]) ? bit : 0;
+  if (level != (_levels & bit))
+    {
+    _levels ^= bit;
+    edge.id = i;
+    edge.level = level ? HIGH : LOW;
+    _edges.Push(edge);
+    }
+  }
+}
+
+// ------------ Function to hand all captured edges to their Inserts (called from loop()) -------------
+void InsertCapture::Process()
 {
-return digitalRead(_pin);  // returns true for an activated device, otherwise false
+InsertEdge edge;
+
+while (_edges.Pop(&edge))
+  _inserts[edge.id]->HandleEdge(edge.level, edge.time);
+}
+
+byte InsertCapture::GetOverflows()
+{
+return _edges.GetOverflows();
 }
+
+// --------- end of implementation of class InsertCapture ---------
+// ===============================================================
+
+// ===============================================================
+// Implementation of class StdInput
+
+// -----------  Constructor for StdInput --------------
+
+StdInput::StdInput(int pin)
+{
+pinMode(pin, INPUT);
+_pin = pin;
+_bank = 0;
+}
+
+// ------------ Function to read the switch -------------
+
+boolean StdInput::ReadInput()
+{
+PLS_PROFILE_SCOPE(PROF_READINPUT);
+if (_bank)
+  return _bank->Read(_bankid);
+return digitalRead(_pin);  // returns true for an activated device, otherwise false
+}
+
+// Function to read the input from the snapshot of a SwitchBank instead of digitalRead()
+byte StdInput::UseSwitchBank(SwitchBank * bank)
+{
+byte id = bank->AddInput(_pin);
+
+if (id != PLS_NO_INPUT)
+  {
+  _bank = bank;
+  _bankid = id;
+  }
+return id;
+}
+
+
+// ===============================================================
+// Implementation of class InputEvents
+
+#define EVENT_SWITCH	0	// kinds of polled inputs
+#define EVENT_OPTO	1
+#define EVENT_INPUT	2
+#define EVENT_INSERT	3
+
+// -----------  Constructor for InputEvents --------------
+
+InputEvents::InputEvents()
+{
+_nrofpolled = 0;
+_nrofinputs = 0;
+_bank = 0;
+_bankmask = 0;
+_bankstate = 0;
+_nrofhandlers = 0;
+}
+
+// Function to register an input. Inputs of the first SwitchBank are read from its
+// snapshot (*source is 0), all others get an entry in _polled.
+byte InputEvents::AddSource(byte kind, SwitchBank * bank, byte bankid, Source ** source)
+{
+*source = 0;
+if (bank && (!_bank || bank == _bank))
+  {
+  _bank = bank;
+  _bankmask |= 1UL << bankid;
+  _bankinput[bankid] = _nrofinputs;
+  return _nrofinputs++;
+  }
+if (_nrofpolled >= PLS_MAX_POLLED_INPUTS)
+  return PLS_NO_INPUT;
+*source = &_polled[_nrofpolled++];
+(*source)->id = _nrofinputs;
+(*source)->kind = kind;
+(*source)->last = kind == EVENT_INSERT ? 3 : false;	// the first known state is reported
+return _nrofinputs++;
+}
+
+byte InputEvents::AddSwitch(Switch * sw)
+{
+Source * source;
+byte id = AddSource(EVENT_SWITCH, sw->_bank, sw->_bankid, &source);
+
+if (source)
+  source->device.sw = sw;
+return id;
+}
+
+byte InputEvents::AddOptoSwitch(OptoSwitch * opto)
+{
+Source * source;
+byte id = AddSource(EVENT_OPTO, opto->_bank, opto->_bankid, &source);
+
+if (source)
+  source->device.opto = opto;
+return id;
+}
+
+byte InputEvents::AddInput(StdInput * input)
+{
+Source * source;
+byte id = AddSource(EVENT_INPUT, input->_bank, input->_bankid, &source);
+
+if (source)
+  source->device.input = input;
+return id;
+}
+
+byte InputEvents::AddInsert(Insert * insert)
+{
+Source * source;
+byte id = AddSource(EVENT_INSERT, 0, 0, &source);
+
+if (source)
+  source->device.insert = insert;
+return id;
+}
+
+// Function to register a handler for the events of one input or of all inputs
+byte InputEvents::OnEvent(PlsEventHandler handler, byte id)
+{
+if (_nrofhandlers >= PLS_MAX_EVENT_HANDLERS)
+  return PLS_NO_SLOT;
+_handlers[_nrofhandlers] = handler;
+_handlerid[_nrofhandlers] = id;
+return _nrofhandlers++;
+}
+
+void InputEvents::Queue(byte id, byte type, unsigned long time)
+{
+PlsEvent event;
+
+event.id = id;
+event.type = type;
+event.time = time;
+_events.Push(event);
+}
+
+// ------------ Function to find the inputs that changed since the last call -------------
+void InputEvents::Update(unsigned long CurrentMillis)
+{
+static const byte insertevent[3] = {PLS_EVENT_OFF, PLS_EVENT_ON, PLS_EVENT_BLINK};
+unsigned long changed;
+byte i, state;
+Source * source;
+
+// inputs from the bank snapshot: one XOR for all of them, then only the changed bits
+if (_bank)
+  {
+  changed = (_bank->GetState() ^ _bankstate) & _bankmask;
+  _bankstate ^= changed;
+  for (i=0; changed; i++, changed >>= 1)
+    if (changed & 1)
+      Queue(_bankinput[i], (_bankstate >> i) & 1 ? PLS_EVENT_PRESS : PLS_EVENT_RELEASE, CurrentMillis);
+  }
+
+// inputs that have to be read one by one
+for (i=0, source=_polled; i<_nrofpolled; i++, source++)
+  {
+  switch (source->kind)
+    {
+    case EVENT_SWITCH:
+      state = source->device.sw->ReadSwitch();
+      break;
+    case EVENT_OPTO:
+      state = source->device.opto->ReadSwitch();
+      break;
+    case EVENT_INPUT:
+      state = source->device.input->ReadInput();
+      break;
+    default:			// EVENT_INSERT
+      state = source->device.insert->GetBlinkInsertState(CurrentMillis);
+      if (state > 2)		// UNDEFINED is not a change
+        continue;
+    }
+  if (state == source->last)
+    continue;
+  source->last = state;
+  if (source->kind == EVENT_INSERT)
+    Queue(source->id, insertevent[state], CurrentMillis);
+  else
+    Queue(source->id, state ? PLS_EVENT_PRESS : PLS_EVENT_RELEASE, CurrentMillis);
+  }
+}
+
+boolean InputEvents::GetEvent(PlsEvent * event)
+{
+return _events.Pop(event);
+}
+
+// ------------ Function to hand all queued events to the handlers -------------
+byte InputEvents::Dispatch()
+{
+PlsEvent event;
+byte n = 0, i;
+
+while (_events.Pop(&event))
+  {
+  for (i=0; i<_nrofhandlers; i++)
+    if (_handlerid[i] == PLS_ANY_INPUT || _handlerid[i] == event.id)
+      _handlers[i](event);
+  n++;
+  }
+return n;
+}
+
+byte InputEvents::GetOverflows()
+{
+return _events.GetOverflows();
+}
+
+// --------- end of implementation of class InputEvents ---------
+// ===============================================================
+
+
+// ===============================================================
+// Implementation of class FrameClock
+
+// -----------  Constructor for FrameClock --------------
+
+FrameClock::FrameClock(unsigned int rate, byte policy, byte maxcatchup)
+{
+_started = false;
+_frames = 0;
+_dropped = 0;
+_catchup = 0;
+SetRate(rate);
+SetPolicy(policy, maxcatchup);
+}
+
+// the only division of the clock in normal operation, once per change of the rate
+void FrameClock::SetRate(unsigned int rate)
+{
+if (rate == 0)
+  rate = 1;
+_period = 1000000UL / rate;
+_periodms = _period / 1000;
+_periodus = _period % 1000;
+}
+
+void FrameClock::SetPolicy(byte policy, byte maxcatchup)
+{
+if (policy == PLS_FRAME_CATCHUP)
+  _maxcatchup = maxcatchup;
+else
+  _maxcatchup = 0;
+}
+
+// ------------ Function to move the frame time on by a number of frames -------------
+void FrameClock::Advance(unsigned long frames)
+{
+unsigned long us;
+
+_framemicros += frames * _period;
+_next = _framemicros + _period;
+if (frames == 1)		// the usual case, no division
+  {
+  _framemillis += _periodms;
+  _restus += _periodus;
+  }
+else
+  {
+  us = frames * _periodus + _restus;
+  _framemillis += frames * _periodms + us / 1000;
+  _restus = us % 1000;
+  }
+if (_restus >= 1000)
+  {
+  _restus -= 1000;
+  _framemillis++;
+  }
+}
+
+/* ------------ Function to check if the next frame is due, call it in every pass of loop() -------------
+   The first call starts the clock and runs the first frame at once. The times
+   are compared by their 32 bit difference, which is negative as long as the
+   frame lies in the future, also when micros() wraps around in between.
+*/
+boolean FrameClock::Due()
+{
+unsigned long now = micros();
+unsigned long missed;
+
+if (!_started)
+  {
+  _started = true;
+  _framemicros = now;
+  _framemillis = millis();
+  _restus = 0;
+  _next = now + _period;
+  _frames++;
+  return true;
+  }
+if ((int32_t)(now - _next) < 0)
+  {
+  _catchup = 0;		// caught up, the next late frames may be run again
+  return false;
+  }
+missed = (uint32_t)(now - _next) / _period;	// frames due after this one, only computed when late
+if (missed && _catchup >= _maxcatchup)
+  {
+  Advance(missed);	// drop them, the frame below is the newest one
+  _dropped += missed;
+  }
+else if (missed)
+  _catchup++;
+Advance(1);
+_frames++;
+return true;
+}
+
+unsigned long FrameClock::GetFrameMillis()
+{
+return _framemillis;
+}
+
+unsigned long FrameClock::GetFrameMicros()
+{
+return _framemicros;
+}
+
+unsigned long FrameClock::GetFrames()
+{
+return _frames;
+}
+
+unsigned long FrameClock::GetDropped()
+{
+return _dropped;
+}
+
+// --------- end of implementation of class FrameClock ---------
+// ===============================================================
+
+
+// ===============================================================
+// Implementation of class EffectScheduler
+
+// -----------  Constructor for EffectScheduler --------------
+
+EffectScheduler::EffectScheduler()
+{
+_nrofslots = 0;
+_tickmillis = 0;
+_clock = 0;
+}
+
+// ------------ Functions to register strips and outputs -------------
+byte EffectScheduler::AddSlot()
+{
+Slot * slot;
+
+if (_nrofslots >= PLS_MAX_SCHEDULED)
+  return PLS_NO_SLOT;
+slot = &_slots[_nrofslots];
+slot->effect = PLS_EFFECT_NONE;
+slot->active = false;
+slot->val = 0;
+slot->delaytime = 0;
+return _nrofslots++;
+}
+
+byte EffectScheduler::AddStrip(RGBStrip * strip)
+{
+byte slot = AddSlot();
+
+if (slot != PLS_NO_SLOT)
+  {
+  _slots[slot].device.strip = strip;
+  _slots[slot].isstrip = true;
+  }
+return slot;
+}
+
+byte EffectScheduler::AddOutput(Std12VOutput * output)
+{
+byte slot = AddSlot();
+
+if (slot != PLS_NO_SLOT)
+  {
+  _slots[slot].device.output = output;
+  _slots[slot].isstrip = false;
+  }
+return slot;
+}
+
+// ------------ Functions to start and stop effects -------------
+// The effect must have been set up on the strip/output before (e.g. with
+// SetupTwoColorFade), it starts with the next call to Tick()
+void EffectScheduler::StartEffect(byte slot, byte effect)
+{
+if (slot >= _nrofslots)
+  return;
+_slots[slot].effect = effect;
+_slots[slot].active = false;	// tells the effect function that it is called for the first time
+}
+
+// switch an output on with val for delaytime ms (uses Std12VOutput::OutputWithDelay)
+void EffectScheduler::StartPulse(byte slot, int val, unsigned int delaytime)
+{
+if (slot >= _nrofslots)
+  return;
+_slots[slot].val = val;
+_slots[slot].delaytime = delaytime;
+if (!_slots[slot].isstrip)
+  _slots[slot].device.output->ResetDelay();	// a new pulse always gets its full time
+StartEffect(slot, PLS_EFFECT_PULSE);
+}
+
+void EffectScheduler::StopEffect(byte slot)
+{
+if (slot >= _nrofslots)
+  return;
+_slots[slot].effect = PLS_EFFECT_NONE;
+if (!_slots[slot].isstrip)
+  _slots[slot].device.output->ResetDelay();
+SwitchOff(&_slots[slot]);
+}
+
+boolean EffectScheduler::EffectActive(byte slot)
+{
+if (slot >= _nrofslots)
+  return false;
+return _slots[slot].effect != PLS_EFFECT_NONE;
+}
+
+void EffectScheduler::SwitchOff(Slot * slot)
+{
+if (slot->isstrip)
+  slot->device.strip->SwitchOff();
+else
+  slot->device.output->Output(0);
+}
+
+// ------------ Function to advance all effects, call it in every pass of loop() -------------
+// Every effect function only compares a few times and writes the PWM values if
+// they changed, so the time of one call grows only with the number of slots.
+// With a FrameClock the effects are advanced once per due frame, with its time.
+void EffectScheduler::Tick()
+{
+PLS_PROFILE_SCOPE(PROF_SCHEDULERTICK);
+
+if (_clock)
+  {
+  while (_clock->Due())
+    Advance(_clock->GetFrameMillis());
+  }
+else
+  Advance(millis());
+}
+
+void EffectScheduler::UseFrameClock(FrameClock * clock)
+{
+_clock = clock;
+}
+
+void EffectScheduler::Advance(unsigned long CurrentMillis)
+{
+Slot * slot;
+byte i;
+
+_tickmillis = CurrentMillis;	// all effects see the same time
+for (i=0; i<_nrofslots; i++)
+  {
+  slot = &_slots[i];
+  if (slot->effect == PLS_EFFECT_NONE)
+    continue;
+  if (slot->isstrip)
+    {
+    switch (slot->effect)
+      {
+      case PLS_EFFECT_RAINBOW:
+        slot->device.strip->RainbowColorChange(_tickmillis);
+        slot->active = true;		// a rainbow never ends by itself
+        break;
+      case PLS_EFFECT_MULTICOLORFLASH:
+        slot->device.strip->MultiColorFlash(_tickmillis, &slot->active);
+        break;
+      case PLS_EFFECT_TWOCOLORFLASH:
+        slot->device.strip->TwoColorFlash(_tickmillis, &slot->active);
+        break;
+      case PLS_EFFECT_TWOCOLORFADE:
+        slot->device.strip->TwoColorFade(_tickmillis, &slot->active);
+        break;
+      case PLS_EFFECT_FLASHES:
+        slot->device.strip->Flashes(_tickmillis, &slot->active);
+        break;
+      case PLS_EFFECT_KEYFRAMES:
+        slot->device.strip->Keyframes(_tickmillis, &slot->active);
+        break;
+      default:
+        slot->active = false;	// effect not available for strips
+        break;
+      }
+    }
+  else
+    {
+    switch (slot->effect)
+      {
+      case PLS_EFFECT_FLASHES:
+        slot->device.output->Flashes(_tickmillis, &slot->active);
+        break;
+      case PLS_EFFECT_PULSE:
+        slot->device.output->OutputWithDelay(slot->val, slot->delaytime, _tickmillis, &slot->active);
+        break;
+      default:
+        slot->active = false;	// effect not available for outputs
+        break;
+      }
+    }
+  if (slot->active == false)	// the first call always sets active, so the effect is finished
+    {
+    slot->effect = PLS_EFFECT_NONE;
+    SwitchOff(slot);
+    }
+  }
+}
+
+unsigned long EffectScheduler::GetTickMillis()
+{
+return _tickmillis;
+}
+
+RGBStrip * EffectScheduler::GetStrip(byte slot)
+{
+if (slot >= _nrofslots || !_slots[slot].isstrip)
+  return 0;
+return _slots[slot].device.strip;
+}
+
+Std12VOutput * EffectScheduler::GetOutput(byte slot)
+{
+if (slot >= _nrofslots || _slots[slot].isstrip)
+  return 0;
+return _slots[slot].device.output;
+}
+
+// --------- end of implementation of class EffectScheduler ---------
+// ===============================================================
+
+
+// ===============================================================
+// Implementation of class StripGroup
+
+// -----------  Constructor for StripGroup --------------
+
+StripGroup::StripGroup()
+{
+_nrofstrips = 0;
+}
+
+// the first strip is the leader, its phase offset is always 0
+byte StripGroup::AddStrip(RGBStrip * strip, unsigned int phaseoffset)
+{
+if (_nrofstrips >= PLS_MAX_GROUP_STRIPS)
+  return PLS_NO_SLOT;
+_strips[_nrofstrips] = strip;
+_offsets[_nrofstrips] = _nrofstrips ? phaseoffset : 0;
+return _nrofstrips++;
+}
+
+void StripGroup::SetPhaseOffset(byte member, unsigned int phaseoffset)
+{
+if (member == 0 || member >= _nrofstrips)
+  return;
+_offsets[member] = phaseoffset;
+}
+
+RGBStrip * StripGroup::GetLeader()
+{
+if (!_nrofstrips)
+  return 0;
+return _strips[0];
+}
+
+// ------------ Function to show the color of the leader on all members -------------
+// Costs one Light call per member, which writes only the pins that changed
+void StripGroup::Update()
+{
+RGBStrip * leader;
+byte i;
+
+if (!_nrofstrips)
+  return;
+leader = _strips[0];
+for (i=1; i<_nrofstrips; i++)
+  _strips[i]->Light(leader->_color[0], leader->_color[1], leader->_color[2]);
+}
+
+// ------------ Function to run the rainbow on the whole group -------------
+// The phase of the rainbow is only advanced on the leader; the members just look
+// up their color at the phase of the leader plus their offset.
+void StripGroup::RainbowColorChange(unsigned long CurrentMillis)
+{
+RGBStrip * leader;
+unsigned int phase;
+byte red, green, blue;
+byte i;
+
+if (!_nrofstrips)
+  return;
+leader = _strips[0];
+leader->RainbowColorChange(CurrentMillis);
+phase = leader->GetRainbowPhase();
+for (i=1; i<_nrofstrips; i++)
+  {
+  if (_offsets[i] == 0)
+    _strips[i]->Light(leader->_color[0], leader->_color[1], leader->_color[2]);
+  else
+    {
+    Phase2RGB(phase + _offsets[i], &red, &green, &blue);
+    _strips[i]->Light(red, green, blue);
+    }
+  }
+}
+
+// --------- end of implementation of class StripGroup ---------
+// ===============================================================
+
+
+// ===============================================================
+// Implementation of class RuleEngine
+
+// columns of a rule set that are not used may be 0
+static unsigned long RuleLong(const unsigned long * column, byte rule)
+{
+return column ? pgm_read_dword(&column[rule]) : 0;
+}
+
+static unsigned int RuleWord(const void * column, byte rule)
+{
+return column ? pgm_read_word((const unsigned int *)column + rule) : 0;
+}
+
+// -----------  Constructor for RuleEngine --------------
+
+RuleEngine::RuleEngine(EffectScheduler * scheduler, SwitchBank * bank)
+{
+_scheduler = scheduler;
+_bank = bank;
+_rules = 0;
+_nrofrules = 0;
+_nrofinserts = 0;
+_bankstate = 0;
+_running = 0;
+}
+
+byte RuleEngine::AddInsert(Insert * insert)
+{
+if (_nrofinserts >= PLS_MAX_RULE_INSERTS)
+  return PLS_NO_INPUT;
+_inserts[_nrofinserts] = insert;
+_insertstate[_nrofinserts] = 3;	// UNDEFINED, the first known state is a change
+return PLS_RULE_INSERT(_nrofinserts++);
+}
+
+// Function to switch to another rule set (0 = no rules), the effects that were
+// kept running by PLS_RULE_WHILE rules of the old set are stopped.
+// Only the first PLS_MAX_RULES rules of a set are used (one bit of _running each).
+void RuleEngine::UseRules(const PlsRuleSet * rules)
+{
+byte i;
+
+for (i=0; i<_nrofrules; i++)
+  if (_running & (1UL << i))
+    _scheduler->StopEffect(pgm_read_byte(&_rules->slot[i]));
+_running = 0;
+_rules = rules;
+_nrofrules = rules ? min(rules->nrofrules, (byte)PLS_MAX_RULES) : 0;
+}
+
+// state of one input in a snapshot: 0/1 for SwitchBank inputs, 0..2 for Inserts
+byte RuleEngine::GetState(byte input, unsigned long bankstate, byte * insertstate)
+{
+if (input < PLS_MAX_BANK_INPUTS)
+  return (bankstate >> input) & 1;
+input -= PLS_MAX_BANK_INPUTS;
+return input < _nrofinserts ? insertstate[input] : 3;
+}
+
+// ------------ Function to check all rules against a snapshot of the inputs -------------
+void RuleEngine::Update(unsigned long CurrentMillis)
+{
+unsigned long bankstate, bit;
+byte insertstate[PLS_MAX_RULE_INSERTS];
+byte i, condition, want, state, slot;
+
+bankstate = _bank ? _bank->GetState() : 0;
+for (i=0; i<_nrofinserts; i++)
+  {
+  insertstate[i] = _inserts[i]->GetBlinkInsertState(CurrentMillis);
+  if (insertstate[i] > 2)		// UNDEFINED: keep the last known state
+    insertstate[i] = _insertstate[i];
+  }
+
+for (i=0, bit=1; i<_nrofrules; i++, bit <<= 1)
+  {
+  condition = pgm_read_byte(&_rules->condition[i]);
+  want = condition & ~PLS_RULE_WHILE;
+  state = GetState(pgm_read_byte(&_rules->input[i]), bankstate, insertstate);
+  if (condition & PLS_RULE_WHILE)
+    {
+    slot = pgm_read_byte(&_rules->slot[i]);
+    if (state == want)
+      {
+      if (!(_running & bit) || !_scheduler->EffectActive(slot))	// start, again when it ended
+        {
+        Fire(i, slot);
+        _running |= bit;
+        }
+      }
+    else if (_running & bit)
+      {
+      _scheduler->StopEffect(slot);
+      _running &= ~bit;
+      }
+    }
+  else if (state == want && GetState(pgm_read_byte(&_rules->input[i]), _bankstate, _insertstate) != want)
+    Fire(i, pgm_read_byte(&_rules->slot[i]));
+  }
+
+_bankstate = bankstate;
+for (i=0; i<_nrofinserts; i++)
+  _insertstate[i] = insertstate[i];
+}
+
+// ------------ Function to set up and start the effect of one rule -------------
+void RuleEngine::Fire(byte rule, byte slot)
+{
+byte effect = pgm_read_byte(&_rules->effect[rule]);
+unsigned long color1 = RuleLong(_rules->color1, rule);
+unsigned long color2 = RuleLong(_rules->color2, rule);
+int param1 = RuleWord(_rules->param1, rule);
+int param2 = RuleWord(_rules->param2, rule);
+unsigned int duration = RuleWord(_rules->duration, rule);
+RGBStrip * strip = _scheduler->GetStrip(slot);
+Std12VOutput * output = _scheduler->GetOutput(slot);
+int rgb1[3], rgb2[3];
+
+switch (effect)
+  {
+  case PLS_EFFECT_FLASHES:
+    if (strip)
+      strip->SetupFlashes(color1, param1, param2);
+    else if (output)
+      output->SetupFlashes(color1, param1, param2);
+    break;
+  case PLS_EFFECT_TWOCOLORFLASH:
+    if (!strip)
+      return;
+    Long2RGB(color1, rgb1);
+    Long2RGB(color2, rgb2);
+    strip->SetupTwoColorFlash(rgb1, rgb2, param1, param2, duration);
+    break;
+  case PLS_EFFECT_TWOCOLORFADE:
+    if (!strip)
+      return;
+    strip->SetupTwoColorFade(color1, color2, param1, param2, duration);
+    break;
+  case PLS_EFFECT_RAINBOW:
+    if (!strip)
+      return;
+    strip->SetRainbowSpeed(param1);
+    break;
+  case PLS_EFFECT_PULSE:
+    _scheduler->StartPulse(slot, param1, duration);
+    return;
+  default:			// PLS_EFFECT_NONE and effects that need more than a rule has
+    _scheduler->StopEffect(slot);
+    return;
+  }
+_scheduler->StartEffect(slot, effect);
+}
+
+// --------- end of implementation of class RuleEngine ---------
+// ===============================================================
+
+
+// ===============================================================
+// Implementation of class ShowPlayer
+
+// -----------  Constructor for ShowPlayer --------------
+
+ShowPlayer::ShowPlayer(RGBStrip * strip)
+{
+_strip = strip;
+_bank = 0;
+_show = 0;
+_pc = 0;
+_op = PLS_OP_END;
+_running = false;
+_color[0] = 0;		// strips start switched off
+_color[1] = 0;
+_color[2] = 0;
+}
+
+void ShowPlayer::Start(const byte * show)
+{
+_show = show;
+_pc = 0;
+_op = PLS_OP_END;
+_nrofloops = 0;
+_running = true;
+}
+
+void ShowPlayer::Stop()
+{
+_running = false;
+}
+
+boolean ShowPlayer::Running()
+{
+return _running;
+}
+
+void ShowPlayer::UseSwitchBank(SwitchBank * bank)
+{
+_bank = bank;
+}
+
+byte ShowPlayer::NextByte()
+{
+return pgm_read_byte(_show + _pc++);
+}
+
+unsigned int ShowPlayer::NextWord()
+{
+unsigned int low = NextByte();
+
+return low | ((unsigned int)NextByte() << 8);
+}
+
+void ShowPlayer::SetColor(byte red, byte green, byte blue)
+{
+_color[0] = red;
+_color[1] = green;
+_color[2] = blue;
+_strip->LightStrip(red, green, blue);
+}
+
+/* ----------- Function to play the show --------
+   Instructions that take no time are executed at once, up to PLS_MAX_SHOW_STEPS
+   of them, so a show without waits can not hang loop().
+*/
+void ShowPlayer::Update(unsigned long CurrentMillis)
+{
+PLS_PROFILE_SCOPE(PROF_SHOWPLAYERUPDATE);
+byte steps;
+
+for (steps=0; _running && steps<PLS_MAX_SHOW_STEPS; steps++)
+  {
+  if (_op != PLS_OP_END)
+    {
+    if (!RunTimed(CurrentMillis))	// still busy
+      return;
+    _op = PLS_OP_END;
+    }
+  Execute(CurrentMillis);
+  }
+}
+
+// ----------- Function to execute the next instruction --------
+void ShowPlayer::Execute(unsigned long CurrentMillis)
+{
+byte op = NextByte();
+byte red, green, blue, count, id;
+unsigned int offset;
+
+switch (op)
+  {
+  case PLS_OP_COLOR:
+    red = NextByte();
+    green = NextByte();
+    blue = NextByte();
+    SetColor(red, green, blue);
+    break;
+  case PLS_OP_WAIT:
+    _duration = NextWord();
+    break;
+  case PLS_OP_FADE:
+    _fadeto[0] = NextByte();
+    _fadeto[1] = NextByte();
+    _fadeto[2] = NextByte();
+    _fadefrom[0] = _color[0];
+    _fadefrom[1] = _color[1];
+    _fadefrom[2] = _color[2];
+    _duration = NextWord();
+    break;
+  case PLS_OP_FLASH:
+    red = NextByte();
+    green = NextByte();
+    blue = NextByte();
+    count = NextByte();
+    _strip->SetupFlashes(RGB2Long(red, green, blue), count, NextWord());
+    _color[0] = red;		// the strip stays on after the last flash
+    _color[1] = green;
+    _color[2] = blue;
+    _active = false;
+    break;
+  case PLS_OP_RAINBOW:
+    _strip->SetRainbowRate(NextWord());
+    _duration = NextWord();
+    break;
+  case PLS_OP_LOOP:
+    count = NextByte();
+    if (_nrofloops >= PLS_MAX_SHOW_LOOPS)	// nested too deep: its NEXT would jump to the outer loop
+      {
+      _running = false;
+      return;
+      }
+    _loopstart[_nrofloops] = _pc;
+    _loopcount[_nrofloops] = count;
+    _nrofloops++;
+    break;
+  case PLS_OP_NEXT:
+    if (_nrofloops == 0)
+      break;
+    if (_loopcount[_nrofloops - 1] == 0 || --_loopcount[_nrofloops - 1] > 0)
+      _pc = _loopstart[_nrofloops - 1];
+    else
+      _nrofloops--;		// loop is done
+    break;
+  case PLS_OP_JUMP:
+    _pc = NextWord();
+    break;
+  case PLS_OP_IFINPUT:
+    id = NextByte();
+    offset = NextWord();
+    if (_bank && _bank->Read(id))
+      _pc = offset;
+    break;
+  default:			// PLS_OP_END or an unknown instruction
+    _running = false;
+    return;
+  }
+if (op == PLS_OP_WAIT || op == PLS_OP_FADE || op == PLS_OP_FLASH || op == PLS_OP_RAINBOW)
+  {
+  _op = op;
+  _starttime = CurrentMillis;
+  RunTimed(CurrentMillis);	// shows the first step at once
+  }
+}
+
+// ----------- Function to advance a timed instruction, returns true when it is over --------
+boolean ShowPlayer::RunTimed(unsigned long CurrentMillis)
+{
+unsigned long elapsed = CurrentMillis - _starttime;
+unsigned int frac;
+byte red, green, blue;
+byte i;
+
+switch (_op)
+  {
+  case PLS_OP_FADE:
+    if (elapsed >= _duration)
+      {
+      SetColor(_fadeto[0], _fadeto[1], _fadeto[2]);
+      return true;
+      }
+    frac = (elapsed << 8) / _duration;	// 0..255, the only division per call
+    for (i=0; i<=2; i++)
+      _color[i] = ((unsigned int)_fadefrom[i] * (256 - frac) + (unsigned int)_fadeto[i] * frac) >> 8;
+    _strip->LightStrip(_color[0], _color[1], _color[2]);
+    return false;
+  case PLS_OP_FLASH:
+    _strip->Flashes(CurrentMillis, &_active);
+    return !_active;
+  case PLS_OP_RAINBOW:
+    _strip->RainbowColorChange(CurrentMillis);
+    if (elapsed < _duration)
+      return false;
+    Phase2RGB(_strip->GetRainbowPhase(), &red, &green, &blue);
+    _color[0] = red;		// fades after the rainbow start at its last color
+    _color[1] = green;
+    _color[2] = blue;
+    return true;
+  default:			// PLS_OP_WAIT
+    return elapsed >= _duration;
+  }
+}
+
+// --------- end of implementation of class ShowPlayer ---------
+// ===============================================================
+
+
+// ===============================================================
+// Implementation of class FrameReceiver
+
+#define FRAME_WAIT_SYNC		0
+#define FRAME_MASK		1
+#define FRAME_COLOR		2
+#define FRAME_CRC		3
+
+// -----------  Constructor for FrameReceiver --------------
+
+FrameReceiver::FrameReceiver(Stream * stream)
+{
+_stream = stream;
+_nrofstrips = 0;
+_state = FRAME_WAIT_SYNC;
+_frames = 0;
+_errors = 0;
+}
+
+byte FrameReceiver::AddStrip(RGBStrip * strip)
+{
+if (_nrofstrips >= PLS_MAX_FRAME_STRIPS)
+  return PLS_NO_SLOT;
+_strips[_nrofstrips] = strip;
+return _nrofstrips++;
+}
+
+// ------------ Function to parse all received bytes -------------
+byte FrameReceiver::Poll()
+{
+byte shown = 0;
+byte data, m;
+int c;
+
+while ((c = _stream->read()) >= 0)
+  {
+  data = c;
+  switch (_state)
+    {
+    case FRAME_WAIT_SYNC:
+      if (data == PLS_FRAME_SYNC)
+        _state = FRAME_MASK;
+      break;
+    case FRAME_MASK:
+      _mask = data;
+      _crc = PlsCrc8(0, data);
+      _length = 0;
+      for (m=data; m; m >>= 1)	// 3 bytes per strip in the mask
+        if (m & 1)
+          _length += 3;
+      _pos = 0;
+      _state = _length ? FRAME_COLOR : FRAME_CRC;
+      break;
+    case FRAME_COLOR:
+      _payload[_pos++] = data;
+      _crc = PlsCrc8(_crc, data);
+      if (_pos >= _length)
+        _state = FRAME_CRC;
+      break;
+    default:			// FRAME_CRC
+      if (data == _crc)
+        {
+        ShowFrame();
+        shown++;
+        }
+      else
+        _errors++;
+      _state = FRAME_WAIT_SYNC;
+      break;
+    }
+  }
+return shown;
+}
+
+void FrameReceiver::ShowFrame()
+{
+byte i, pos = 0;
+
+for (i=0; i<PLS_MAX_FRAME_STRIPS; i++)
+  {
+  if (!(_mask & (1 << i)))
+    continue;
+  if (i < _nrofstrips)		// colors for strips that don't exist are skipped
+    _strips[i]->LightStrip(_payload[pos], _payload[pos + 1], _payload[pos + 2]);
+  pos += 3;
+  }
+_frames++;
+}
+
+unsigned long FrameReceiver::GetFrames()
+{
+return _frames;
+}
+
+unsigned long FrameReceiver::GetErrors()
+{
+return _errors;
+}
+
+// --------- end of implementation of class FrameReceiver ---------
+// ===============================================================
+
+
+// ===============================================================
+// Implementation of class EepromConfig
+
+// -----------  Constructor for EepromConfig --------------
+
+EepromConfig::EepromConfig(unsigned int address)
+{
+_address = address;
+_nrofstrips = 0;
+_nrofinserts = 0;
+_written = 0;
+}
+
+byte EepromConfig::AddStrip(RGBStrip * strip)
+{
+if (_nrofstrips >= PLS_MAX_CONFIG_STRIPS)
+  return PLS_NO_SLOT;
+_strips[_nrofstrips] = strip;
+return _nrofstrips++;
+}
+
+byte EepromConfig::AddInsert(Insert * insert)
+{
+if (_nrofinserts >= PLS_MAX_CONFIG_INSERTS)
+  return PLS_NO_SLOT;
+_inserts[_nrofinserts] = insert;
+return _nrofinserts++;
+}
+
+// ------------ Functions to read the EEPROM at _pos, every byte goes into the CRC -------------
+byte EepromConfig::Read()
+{
+byte data = eeprom_read_byte((const uint8_t *)(uintptr_t)_pos++);
+
+_crc = PlsCrc8(_crc, data);
+return data;
+}
+
+unsigned int EepromConfig::ReadWord()
+{
+unsigned int low = Read();
+
+return low | ((unsigned int)Read() << 8);
+}
+
+unsigned long EepromConfig::ReadColor()
+{
+unsigned long color = (unsigned long)Read() << 16;
+
+color |= (unsigned int)Read() << 8;
+return color | Read();
+}
+
+/* ------------ Function to set up the registered objects from the EEPROM -------------
+   The records are read twice: once for the CRC and once to apply them, so a
+   broken config changes nothing. Reading a byte takes about 2 us.
+*/
+boolean EepromConfig::Load()
+{
+unsigned int length, end, next;
+byte crc, type, object, size;
+
+if (_address > E2END + 1 - PLS_CONFIG_HEADER)
+  return false;
+_pos = _address;
+if (Read() != 'P' || Read() != 'C' || Read() != PLS_CONFIG_VERSION)
+  return false;
+length = ReadWord();
+crc = Read();
+if (length > E2END + 1 - PLS_CONFIG_HEADER - _address)
+  return false;
+end = _pos + length;
+_crc = 0;
+while (_pos < end)
+  Read();
+if (_crc != crc)
+  return false;
+
+_pos = _address + PLS_CONFIG_HEADER;
+while (_pos + 3 <= end)
+  {
+  type = Read();
+  object = Read();
+  size = Read();
+  next = _pos + size;
+  if (next > end)
+    break;
+  Apply(type, object, size);
+  _pos = next;		// also skips records of unknown types
+  }
+return true;
+}
+
+void EepromConfig::Apply(byte type, byte object, byte length)
+{
+RGBStrip * strip = object < _nrofstrips ? _strips[object] : 0;
+Insert * insert = object < _nrofinserts ? _inserts[object] : 0;
+unsigned long from, to;
+unsigned int speed;
+byte step, n, i;
+
+switch (type)
+  {
+  case PLS_CONFIG_BRIGHTNESS:
+    if (strip && length == 2)
+      {
+      strip->SetBrightness(Read());
+      strip->SetGamma(Read());
+      }
+    break;
+  case PLS_CONFIG_RAINBOWSPEED:
+    if (strip && length == 2)
+      strip->SetRainbowSpeed((int)ReadWord());
+    break;
+  case PLS_CONFIG_TWOCOLORFADE:
+    if (strip && length == 11)
+      {
+      from = ReadColor();
+      to = ReadColor();
+      step = Read();
+      speed = ReadWord();
+      strip->SetupTwoColorFade(from, to, step, speed, ReadWord());
+      }
+    break;
+  case PLS_CONFIG_MULTICOLORFLASH:	// straight into the strip, like SetupMultiColorFlash
+    n = (length - 3) / 5;
+    if (strip && length >= 3 && length == 3 + n * 5 && n <= 5)
+      {
+      strip->UseEffect(PLS_EFFECT_MULTICOLORFLASH);
+      strip->_fx.multi.randsequence = Read();
+      strip->_fx.multi.duration = ReadWord();
+      strip->_fx.multi.nrofcolors = n;
+      for (i=0; i<5; i++)
+        {
+        strip->_fx.multi.colors[i] = i < n ? ReadColor() : 0;
+        strip->_fx.multi.durations[i] = i < n ? ReadWord() : 0;
+        }
+      strip->_fx.multi.activeindex = 0;
+      strip->_fx.multi.starttime = 0;
+      }
+    break;
+  case PLS_CONFIG_INSERTDELAYS:
+    if (insert && length == 6)
+      {
+      insert->SetAdaptiveDelays(false);	// the stored delays are meant to be used
+      insert->_filterdelay = ReadWord();
+      insert->_insertondelay = ReadWord();
+      insert->_insertoffdelay = ReadWord();
+      }
+    break;
+  }
+}
+
+// ------------ Functions to write the EEPROM at _pos, only bytes that changed are written -------------
+void EepromConfig::Write(byte data)
+{
+_crc = PlsCrc8(_crc, data);
+if (_pos > E2END)
+  {
+  _full = true;
+  return;
+  }
+if (eeprom_read_byte((const uint8_t *)(uintptr_t)_pos) != data)
+  {
+  eeprom_write_byte((uint8_t *)(uintptr_t)_pos, data);
+  _written++;
+  }
+_pos++;
+}
+
+void EepromConfig::WriteWord(unsigned int data)
+{
+Write(data & 0xff);
+Write(data >> 8);
+}
+
+void EepromConfig::WriteColor(unsigned long color)
+{
+Write(GetRed(color));
+Write(GetGreen(color));
+Write(GetBlue(color));
+}
+
+void EepromConfig::BeginRecord(byte type, byte object, byte length)
+{
+Write(type);
+Write(object);
+Write(length);
+}
+
+void EepromConfig::BeginSave()
+{
+_pos = _address + PLS_CONFIG_HEADER;
+_crc = 0;
+_full = false;
+_written = 0;
+}
+
+void EepromConfig::SaveBrightness(byte strip, int brightness, boolean gamma)
+{
+BeginRecord(PLS_CONFIG_BRIGHTNESS, strip, 2);
+Write(constrain(brightness, 0, 100));
+Write(gamma);
+}
+
+void EepromConfig::SaveRainbowSpeed(byte strip, int RainbowSpeed)
+{
+BeginRecord(PLS_CONFIG_RAINBOWSPEED, strip, 2);
+WriteWord(RainbowSpeed);
+}
+
+void EepromConfig::SaveTwoColorFade(byte strip, unsigned long fadecolorfrom, unsigned long fadecolorto, int fadestep, unsigned int fadespeed, unsigned int FadeDuration)
+{
+BeginRecord(PLS_CONFIG_TWOCOLORFADE, strip, 11);
+WriteColor(fadecolorfrom);
+WriteColor(fadecolorto);
+Write(constrain(fadestep, 1, 5));
+WriteWord(fadespeed);
+WriteWord(FadeDuration);
+}
+
+// only the nrofcolors colors that are used are stored
+void EepromConfig::SaveMultiColorFlash(byte strip, byte nrofcolors, unsigned long colors[5], unsigned int durations[5], boolean randsequence, unsigned int FlashDuration)
+{
+byte i;
+
+nrofcolors = min(nrofcolors, (byte)5);
+BeginRecord(PLS_CONFIG_MULTICOLORFLASH, strip, 3 + nrofcolors * 5);
+Write(randsequence);
+WriteWord(FlashDuration);
+for (i=0; i<nrofcolors; i++)
+  {
+  WriteColor(colors[i]);
+  WriteWord(durations[i]);
+  }
+}
+
+void EepromConfig::SaveInsertDelays(byte insert, unsigned int FilterDelay, unsigned int InsertOnDelay, unsigned int InsertOffDelay)
+{
+BeginRecord(PLS_CONFIG_INSERTDELAYS, insert, 6);
+WriteWord(FilterDelay);
+WriteWord(InsertOnDelay);
+WriteWord(InsertOffDelay);
+}
+
+// the header goes last, so the config is only valid when all records are written
+boolean EepromConfig::EndSave()
+{
+unsigned int length = _pos - _address - PLS_CONFIG_HEADER;
+byte crc = _crc;
+
+if (_full)
+  return false;
+_pos = _address;
+Write('P');
+Write('C');
+Write(PLS_CONFIG_VERSION);
+WriteWord(length);
+Write(crc);
+return !_full;
+}
+
+unsigned int EepromConfig::GetBytesWritten()
+{
+return _written;
+}
+
+// --------- end of implementation of class EepromConfig ---------
+// ===============================================================
+
+
+#if defined(PLS_PROFILE)
+// ===============================================================
+// Implementation of class PlsProfiler
+
+// names of the entries, same order as the PROF_ ids at the top of this file
+static const char _profilenames[PLS_PROFILE_ENTRIES][32] PROGMEM = {
+  "RGBStrip::LightStrip", "RGBStrip::RainbowColorChange", "RGBStrip::MultiColorFlash",
+  "RGBStrip::TwoColorFlash", "RGBStrip::TwoColorFade", "RGBStrip::Flashes",
+  "RGBStrip::Keyframes", "Std12VOutput::Output", "Std12VOutput::OutputWithDelay",
+  "Std12VOutput::Flashes", "SwitchBank::Update", "Switch::ReadSwitch",
+  "Switch::ReadSwitchDelayed", "OptoSwitch::ReadSwitch", "OptoSwitch::ReadSwitchDelayed",
+  "Insert::InsertOn", "Insert::GetBlinkInsertState", "StdInput::ReadInput",
+  "EffectScheduler::Tick", "ShowPlayer::Update"
+};
+
+unsigned long PlsProfiler::_calls[PLS_PROFILE_ENTRIES];
+unsigned long PlsProfiler::_total[PLS_PROFILE_ENTRIES];
+unsigned int PlsProfiler::_max[PLS_PROFILE_ENTRIES];
+unsigned long PlsProfiler::_loops[PLS_PROFILE_BUCKETS];
+unsigned long PlsProfiler::_lastloop = 0;
+unsigned long PlsProfiler::_maxloop = 0;
+
+void PlsProfiler::Add(byte entry, unsigned long us)
+{
+_calls[entry]++;
+_total[entry] += us;
+if (us > _max[entry])
+  _max[entry] = us > 65535UL ? 65535U : us;
+}
+
+// ------------ Function to measure the time since the last call (once per loop()) -------------
+void PlsProfiler::LoopMark()
+{
+unsigned long now = micros();
+unsigned long us = now - _lastloop;
+byte bucket = 0;
+
+if (_lastloop)			// the first call only starts the measurement
+  {
+  while (us > 1 && bucket < PLS_PROFILE_BUCKETS - 1)	// bucket = log2(us)
+    {
+    us >>= 1;
+    bucket++;
+    }
+  _loops[bucket]++;
+  if (now - _lastloop > _maxloop)
+    _maxloop = now - _lastloop;
+  }
+_lastloop = now ? now : 1;
+}
+
+// ------------ Function to print the profile to Serial -------------
+void PlsProfiler::Dump()
+{
+byte i, j;
+char c;
+
+Serial.println("loop time us\tloops");
+for (i=0; i<PLS_PROFILE_BUCKETS; i++)
+  {
+  if (!_loops[i])
+    continue;
+  Serial.print(i ? 1UL << i : 0UL);
+  Serial.print(i < PLS_PROFILE_BUCKETS - 1 ? "..\t" : "+\t");
+  Serial.println(_loops[i]);
+  }
+Serial.print("max loop time us\t");
+Serial.println(_maxloop);
+Serial.println("method\tcalls\ttotal us\tmax us\tavg us");
+for (i=0; i<PLS_PROFILE_ENTRIES; i++)
+  {
+  if (!_calls[i])
+    continue;
+  for (j=0; (c = pgm_read_byte(&_profilenames[i][j])) != 0; j++)
+    Serial.print(c);
+  Serial.print('\t');
+  Serial.print(_calls[i]);
+  Serial.print('\t');
+  Serial.print(_total[i]);
+  Serial.print('\t');
+  Serial.print(_max[i]);
+  Serial.print('\t');
+  Serial.println(_total[i] / _calls[i]);
+  }
+}
+
+void PlsProfiler::Reset()
+{
+byte i;
+
+for (i=0; i<PLS_PROFILE_ENTRIES; i++)
+  {
+  _calls[i] = 0;
+  _total[i] = 0;
+  _max[i] = 0;
+  }
+for (i=0; i<PLS_PROFILE_BUCKETS; i++)
+  _loops[i] = 0;
+_lastloop = 0;
+_maxloop = 0;
+}
+
+// --------- end of implementation of class PlsProfiler ---------
+// ===============================================================
+#endif
@@ -10,6 +10,36 @@
 	      added function SwitchOff
 	      function LightStrip can now be used in 3 variants
 	      added function MultiColorFlash
+ Version 2:   brightness is applied with a fixed point factor instead of
+	      a division per color, added function SetGamma
+	      RGBStrip and Std12VOutput skip writes of unchanged PWM values
+	      added non-blocking Flashes and class EffectScheduler
+	      added class SwitchBank to read all inputs with one access per port
+	      added SwitchDebouncer8/16/32 (vertical counter debouncing)
+	      ReadSwitchDelayed no longer fails after 32s or when millis() is 0
+	      added class InsertCapture (pin change interrupts for Inserts)
+	      Inserts can measure their blink period and adapt their delays
+	      RainbowColorChange uses a phase accumulator (no divisions, no stale
+	      colors after missed calls), added SetRainbowRate and Phase2RGB
+	      added RGBStripT, Std12VOutputT, SwitchT, OptoSwitchT and StdInputT
+	      (pins as template parameters, direct register access on the Uno)
+	      the effects of RGBStrip share their memory, only the effect that
+	      was set up last keeps its state
+	      added class BAMOutput (software PWM on any pin), see UseBAM
+	      added class ShowPlayer to play light shows stored in flash
+	      added Keyframes effect (color palettes of any length from flash)
+	      added class FrameReceiver to set strips from a PC over Serial
+	      added class InputEvents (press/release/ON/OFF/BLINK events)
+	      added PLS_PROFILE and class PlsProfiler (loop time histogram,
+	      calls and time per method)
+	      added class RuleEngine (rules in flash start effects on inputs)
+	      added class AddressableStrip (WS2812 pixels), RGBStrips can be
+	      segments of it
+	      added HSV2RGB, HSV2Long and LightStripHSV (integer HSV colors)
+	      added class StripGroup (one effect shown in sync on several strips)
+	      added class FrameClock (fixed effect rate), EffectScheduler can use it;
+	      all durations are unsigned int (up to 65535 ms instead of 32767)
+	      added class EepromConfig (effect parameters stored in the EEPROM)
 ---------------------------------------------------------------*/
 
 #ifndef pls_h
@@ -26,66 +56,298 @@ void Long2RGB(unsigned long color, int RGB[3]);
 byte GetRed(unsigned long color);
 byte GetGreen(unsigned long color);
 byte GetBlue(unsigned long color);
+void Phase2RGB(unsigned int phase, byte * red, byte * green, byte * blue);
+void HSV2RGB(byte hue, byte sat, byte val, byte * red, byte * green, byte * blue);
+void HSV2RGB(const byte * hsv, byte * rgb, unsigned int count);	// count colors, 3 bytes each
+unsigned long HSV2Long(byte hue, byte sat, byte val);
+byte PlsCrc8(byte crc, byte data);	// CRC-8, polynomial 0x07
 
+// keeps the compiler from moving memory accesses across this point
+#define PLS_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+/* Ring buffer for one producer and one consumer, e.g. an interrupt routine that
+   pushes and loop() that pops. No interrupts need to be disabled: only the
+   producer writes _head and only the consumer writes _tail, both are single bytes.
+   SIZE must be a power of 2 and at most 128.
+*/
+template <class T, byte SIZE> class PlsRingBuffer
+{
+  public:
+    // constexpr: a static buffer needs no constructor call at startup, so it is only
+    // linked when its methods are used
+    constexpr PlsRingBuffer() : _items{}, _head(0), _tail(0), _overflows(0)
+      {
+      static_assert(SIZE > 0 && SIZE <= 128 && (SIZE & (SIZE - 1)) == 0, "SIZE must be a power of 2 up to 128");
+      }
+    boolean Push(const T & item);	// producer side, returns false if the buffer is full
+    boolean Pop(T * item);		// consumer side, returns false if the buffer is empty
+    byte Available();
+    byte GetOverflows();		// number of items lost because the buffer was full
+  private:
+    T _items[SIZE];
+    volatile byte _head;		// next free slot, free running
+    volatile byte _tail;		// oldest item, free running
+    volatile byte _overflows;
+};
+
+template <class T, byte SIZE> boolean PlsRingBuffer<T, SIZE>::Push(const T & item)
+{
+byte head = _head;
+
+if ((byte)(head - _tail) >= SIZE)
+  {
+  if (_overflows < 255)
+    _overflows++;
+  return false;
+  }
+_items[head & (SIZE - 1)] = item;
+PLS_BARRIER();			// the item must be stored before the consumer can see it
+_head = head + 1;
+return true;
+}
+
+template <class T, byte SIZE> boolean PlsRingBuffer<T, SIZE>::Pop(T * item)
+{
+byte tail = _tail;
+
+if (tail == _head)
+  return false;
+PLS_BARRIER();
+*item = _items[tail & (SIZE - 1)];
+PLS_BARRIER();			// the item must be copied before the producer may reuse the slot
+_tail = tail + 1;
+return true;
+}
+
+template <class T, byte SIZE> byte PlsRingBuffer<T, SIZE>::Available()
+{
+return _head - _tail;
+}
+
+template <class T, byte SIZE> byte PlsRingBuffer<T, SIZE>::GetOverflows()
+{
+return _overflows;
+}
+
+
+// Profiling, off by default: remove the // in front of PLS_PROFILE (or add
+// -DPLS_PROFILE to the compiler flags of the library) to count calls and time
+// of the methods of RGBStrip, Std12VOutput and the inputs, see PlsProfiler.
+// #define PLS_PROFILE
+
+#define PLS_PROFILE_ENTRIES	20	// instrumented methods, see the list in pls.cpp
+#define PLS_PROFILE_BUCKETS	16	// loop times 0-1, 2-3, 4-7, ... 16384-32767, >= 32768 us
+
+/* This class collects the profile when PLS_PROFILE is defined. Every instrumented
+   method measures itself with micros() (calls, total and longest time; times are
+   inclusive, e.g. TwoColorFade includes its LightStrip calls, and micros() counts
+   in steps of 4 us on a 16 MHz board). Call LoopMark() at the start of loop() to
+   get a histogram of the loop times, Dump() prints everything to Serial.
+   A measured call costs about 12 us more (two micros() calls and the bookkeeping,
+   ~190 cycles on a 16 MHz ATmega328P), LoopMark() about 13 us; the counters take
+   272 bytes of RAM. Without PLS_PROFILE all of this compiles to nothing.
+   The template classes (RGBStripT etc.) are not instrumented.
+*/
+class PlsProfiler
+{
+  public:
+#if defined(PLS_PROFILE)
+    static void LoopMark();
+    static void Dump();
+    static void Reset();
+  private:
+    friend class PlsProfileScope;
+    static void Add(byte entry, unsigned long us);
+    static unsigned long _calls[PLS_PROFILE_ENTRIES];
+    static unsigned long _total[PLS_PROFILE_ENTRIES];	// us
+    static unsigned int _max[PLS_PROFILE_ENTRIES];	// us
+    static unsigned long _loops[PLS_PROFILE_BUCKETS];
+    static unsigned long _lastloop;		// micros() of the last LoopMark()
+    static unsigned long _maxloop;
+#else
+    static void LoopMark() {}
+    static void Dump() {}
+    static void Reset() {}
+#endif
+};
+
+
+// Effects of RGBStrip and Std12VOutput, also used by the EffectScheduler. The effect
+// has to be set up on the RGBStrip/Std12VOutput first (SetupTwoColorFade, SetupFlashes etc.)
+#define PLS_EFFECT_NONE			0
+#define PLS_EFFECT_RAINBOW		1	// RGBStrip only, runs until stopped
+#define PLS_EFFECT_MULTICOLORFLASH	2	// RGBStrip only
+#define PLS_EFFECT_TWOCOLORFLASH	3	// RGBStrip only
+#define PLS_EFFECT_TWOCOLORFADE		4	// RGBStrip only
+#define PLS_EFFECT_FLASHES		5	// RGBStrip and Std12VOutput
+#define PLS_EFFECT_PULSE		6	// Std12VOutput only, see StartPulse
+#define PLS_EFFECT_KEYFRAMES		7	// RGBStrip only
+
+// how a keyframe gets to the next one
+#define PLS_KEY_HARDCUT		0	// keep the color, then jump
+#define PLS_KEY_LINEAR		1
+#define PLS_KEY_EASE		2	// slow start and end (smoothstep)
+
+// what happens after the last keyframe
+#define PLS_KEY_ONCE		0	// hold the last color for its duration, then the effect ends
+#define PLS_KEY_LOOP		1	// go on to the first keyframe
+#define PLS_KEY_PINGPONG	2	// go back to the first keyframe and forth again
+
+/* One keyframe of a palette for RGBStrip::SetupKeyframes, palettes are kept in flash:
+     const PlsKeyframe Fire[] PROGMEM = {
+       {255,  40,  0, PLS_KEY_EASE,    300},
+       {255, 120,  0, PLS_KEY_LINEAR,  150},
+       {180,   0,  0, PLS_KEY_HARDCUT,  80}
+     };
+   interp and duration describe the way to the next keyframe. MultiColorFlash is a
+   palette of PLS_KEY_HARDCUT keyframes with PLS_KEY_LOOP, TwoColorFade a palette of
+   two PLS_KEY_LINEAR keyframes with PLS_KEY_PINGPONG.
+*/
+struct PlsKeyframe
+{
+  byte red;
+  byte green;
+  byte blue;
+  byte interp;			// PLS_KEY_HARDCUT, PLS_KEY_LINEAR or PLS_KEY_EASE
+  uint16_t duration;		// ms to the next keyframe
+};
 
 // PinLightShield classes
+class AddressableStrip;
+
 class RGBStrip
 {
   public:
     RGBStrip(int redpin, int greenpin, int bluepin, int brightness = 100);
+    RGBStrip(AddressableStrip * pixels, unsigned int first, unsigned int count, int brightness = 100);
     void LightStrip(unsigned long color);
     void LightStrip(int redval, int greenval, int blueval);
     void LightStrip(int color[3]);
+    void LightStripHSV(byte hue, byte sat, byte val);	// see HSV2RGB
+    void LightStripHSV(byte hsv[3]);
     void SwitchOff();
     void MakeFlashes(unsigned long color, int flashes, int flashlength);
+    void SetupFlashes(unsigned long color, int flashes, unsigned int flashlength);
+    void Flashes(unsigned long CurrentMillis, boolean * FlashActive);
     void SetBrightness(int brightness);
+    void SetGamma(boolean gamma);
+    unsigned long GetWritesIssued();
+    unsigned long GetWritesSkipped();
+    void ResetWriteCounters();
+    boolean UseBAM();		// drive the pins with BAMOutput instead of analogWrite
     void RainbowColorChange(unsigned long CurrentMillis);
     void SetRainbowSpeed(int RainbowSpeed);
-    void SetupMultiColorFlash(byte nrofcolors, unsigned long colors[5], int durations[5], boolean randsequence, int FlashDuration);
+    void SetRainbowRate(unsigned int rate);	// phase steps per ms in 1/256 (65536 steps = 1 cycle)
+    void SetRainbowPhase(unsigned int phase);
+    unsigned int GetRainbowPhase();
+    void SetupMultiColorFlash(byte nrofcolors, unsigned long colors[5], unsigned int durations[5], boolean randsequence, unsigned int FlashDuration);
     void MultiColorFlash(unsigned long CurrentMillis, boolean * FlashActive);
-    void SetupTwoColorFlash(int color1[3], int color2[3], int Col1Duration, int Col2Duration, int FlashDuration);
+    void SetupTwoColorFlash(int color1[3], int color2[3], unsigned int Col1Duration, unsigned int Col2Duration, unsigned int FlashDuration);
     void TwoColorFlash(unsigned long CurrentMillis, boolean * FlashActive);
-    void SetupTwoColorFade(unsigned long fadecolorfrom, unsigned long fadecolorto, int fadestep, int fadespeed, int FadeDuration);
+    void SetupTwoColorFade(unsigned long fadecolorfrom, unsigned long fadecolorto, int fadestep, unsigned int fadespeed, unsigned int FadeDuration);
     void TwoColorFade(unsigned long CurrentMillis, boolean * FadeActive);
+    void SetupKeyframes(const PlsKeyframe * keys, byte nrofkeys, byte mode, unsigned long Duration = 0);
+    void Keyframes(unsigned long CurrentMillis, boolean * KeyframesActive);
   private:
-    int _redpin;
-    int _greenpin;
-    int _bluepin;
-    int _brightness;	// range from 1 to 100
-  // variables for RainbowColorChange()
-    int _rainbowblue;	// remember the values of the 3 colors
-    int _rainbowred;
-    int _rainbowgreen;
-    int _fadespeed_rainbow;
-    unsigned long _startrainbow;	// remember the time the last rainbow cycle started
-  // variables for MultiColorFlash
-    byte _nrofcolors;
-    unsigned long _colors[5];
-    int _durations[5];
-    boolean _randsequence;
-    int _MultiFlashDuration;
-    unsigned long _MultiFlashStartTime;
-    unsigned long _LastMultiColorSwitch;
-    byte _ActiveColorIndex;
-  // variables for TwoColorFlash 
-    int _Col1Duration;
-    int _color1[3];
-    int _Col2Duration;
-    int _color2[3];
-    int _FlashDuration;
-    unsigned long _FlashStartTime;
-    unsigned long _LastColorSwitch;
-    boolean _Color1Active;
-  // variables for TwoColorFade
-    int _fadestep[3];
-    int _fadedir[3];
-    int _fadecolor[3];
-    int _fadecolorfrom[3];
-    int _fadecolorto[3];
-    int _fadespeed;
-    int _FadeDuration;
-    unsigned long _LastFadeStep;
-    unsigned long _FadeStartTime;
+    friend class StripGroup;	// reads the color, writes the members
+    friend class EepromConfig;	// loads palettes straight into _fx
+    AddressableStrip * _pixels;	// 0 = analog strip on the pins below
+    union
+      {
+      struct
+        {
+        int red;
+        int green;
+        int blue;
+        } pins;
+      struct			// the strip is a segment of an AddressableStrip
+        {
+        unsigned int first;
+        unsigned int count;
+        } segment;
+      } _out;
+    byte _color[3];		// color of the last LightStrip call, before brightness and gamma
+    unsigned int _brightscale;	// brightness as fixed point factor (256 = 100%)
+    boolean _gamma;		// apply gamma correction to the output values
+    int _lastduty[3];		// last PWM value written to each pin (-1 = unknown)
+    unsigned long _writesissued;	// number of analogWrite calls
+    unsigned long _writesskipped;	// number of writes skipped because nothing changed
+  // State of the effect that was set up last. Only one effect runs at a time, so
+  // all effects share the same memory. _effect tells which one is stored.
+    byte _effect;
+    union
+      {
+      struct			// RainbowColorChange
+        {
+        unsigned long phase;	// position in the rainbow in 1/256 phase steps
+        unsigned long last;	// time of the last call
+        unsigned int rate;	// phase steps per ms in 1/256
+        } rainbow;
+      struct			// MultiColorFlash
+        {
+        byte nrofcolors;
+        unsigned long colors[5];
+        unsigned int durations[5];	// ms, all durations up to 65535 ms
+        boolean randsequence;
+        unsigned int duration;
+        unsigned long starttime;
+        unsigned long lastswitch;
+        byte activeindex;
+        } multi;
+      struct			// TwoColorFlash
+        {
+        unsigned int col1duration;
+        int color1[3];
+        unsigned int col2duration;
+        int color2[3];
+        unsigned int duration;
+        unsigned long starttime;
+        unsigned long lastswitch;
+        boolean color1active;
+        } two;
+      struct			// TwoColorFade
+        {
+        int step[3];
+        int dir[3];
+        int color[3];
+        int from[3];
+        int to[3];
+        unsigned int speed;
+        unsigned int duration;
+        unsigned long laststep;
+        unsigned long starttime;
+        } fade;
+      struct			// Flashes
+        {
+        unsigned long color;
+        unsigned int length;
+        byte phases;		// number of on and off phases of the whole flash train
+        byte phase;		// current phase, even = on, odd = off
+        unsigned long lasttoggle;
+        } flashes;
+      struct			// Keyframes
+        {
+        const PlsKeyframe * keys;	// in PROGMEM
+        byte nrofkeys;
+        byte mode;
+        byte index;		// keyframe the segment starts at
+        signed char dir;	// +1 forward, -1 backward (ping-pong)
+        byte interp;
+        byte from[3];
+        byte to[3];
+        unsigned int seglength;	// ms
+        unsigned long step;	// 0.32 fixed point progress per ms, 2^32 / seglength
+        unsigned long segstart;
+        unsigned long starttime;
+        unsigned long duration;	// 0 = no limit
+        } key;
+      } _fx;
+    void Init(int brightness);
+    void UseEffect(byte effect);
+    void StartSegment(byte index);
+    void Light(byte red, byte green, byte blue);
+    byte ScaleColor(int val);
+    void WriteColor(byte red, byte green, byte blue);
     void SwitchDir();
     boolean DetectColorLimit(int color, int fadecolorfrom, int fadecolorto, int colordir);
 };
@@ -96,25 +358,298 @@ class Std12VOutput
   public:
     Std12VOutput(int pin);
     void Output(int val);
-    void OutputWithDelay(int val, int delaytime, unsigned long CurrentMillis, boolean *OutputActive);
+    void OutputWithDelay(int val, unsigned int delaytime, unsigned long CurrentMillis, boolean *OutputActive);
+    void ResetDelay();
     void MakeFlashes(int val, int flashes, int flashlength);
+    void SetupFlashes(int val, int flashes, unsigned int flashlength);
+    void Flashes(unsigned long CurrentMillis, boolean * FlashActive);
+    unsigned long GetWritesIssued();
+    unsigned long GetWritesSkipped();
+    void ResetWriteCounters();
+    boolean UseBAM();		// drive the pin with BAMOutput instead of analogWrite
   private:
     int _pin;
-    int _delaytime;	// used for LightLEDStripDelay to activate the signal for a certain time
+    int _lastduty;		// last PWM value written to the pin (-1 = unknown)
+    unsigned long _writesissued;
+    unsigned long _writesskipped;
+    unsigned int _delaytime;	// used for LightLEDStripDelay to activate the signal for a certain time
     unsigned long _starttime;  // start of delayed activation
+    int _flashval;		// variables for Flashes, see RGBStrip
+    unsigned int _flashlength;
+    byte _flashphases;
+    byte _flashphase;
+    unsigned long _LastFlashToggle;
 };
 
+#define PLS_MAX_BAM_PORTS	4	// different ports (PORTB, PORTC, ...) driven by BAMOutput
+#define PLS_BAM_MIN_TICK	32	// shortest bit plane in timer ticks (0.5 us), must be
+					// longer than the interrupt routine takes
+
+/* This class makes PWM signals on any pin with bit angle modulation, so strips
+   and outputs are no longer limited to the 6 PWM pins of an Uno. Bit n of every
+   duty value is shown for 2^n ticks, the 8 bit planes make up one refresh cycle
+   of 255 ticks. The timer 1 interrupt only fires once per bit plane (8 times per
+   cycle) and writes whole ports, so its cost does not depend on the number of pins:
+
+     refresh rate   shortest plane   interrupts/s   CPU time (3 ports)
+        100 Hz          39 us             800           ~1.0 %
+        150 Hz          26 us            1200           ~1.4 %
+        200 Hz          20 us            1600           ~1.9 %
+        245 Hz (max)    16 us            1960           ~2.3 %
+
+   (about 190 cycles per interrupt on a 16 MHz ATmega328P, estimated from the
+   code, 25 cycles less per port that is not used). Rates below 100 Hz may flicker.
+   Timer 1 is taken over, so analogWrite no longer works on pins 9 and 10 (Uno)
+   and the Servo library can not be used at the same time.
+   Call RGBStrip::UseBAM() or Std12VOutput::UseBAM() and BAMOutput::Start() in
+   setup() and put PLS_BAM_ISR() once into the sketch (outside of any function).
+   LightStrip and Output work as before.
+*/
+class BAMOutput
+{
+  public:
+    static boolean Attach(int pin);		// returns false if too many ports are used
+    static boolean Attached(int pin);
+    static void Write(int pin, byte duty);	// takes effect with the next refresh cycle
+    static void Start(unsigned int refreshrate = 200);	// in Hz, see table above
+    static void Stop();
+    static void HandleInterrupt();		// called by the timer interrupt routine
+  private:
+    static volatile uint8_t * _portreg[PLS_MAX_BAM_PORTS];
+    static byte _portmask[PLS_MAX_BAM_PORTS];	// pins of the port driven by BAM
+    static byte _planes[8][PLS_MAX_BAM_PORTS];	// bit n of all duty values per port
+    static byte _nrofports;
+    static byte _pinport[NUM_DIGITAL_PINS];	// index into _portreg + 1, 0 = not attached
+    static byte _bit;				// bit plane shown next
+    static unsigned int _tick;			// timer ticks of bit plane 0
+};
+
+#if defined(TIMER1_COMPA_vect)
+#define PLS_BAM_ISR() \
+  ISR(TIMER1_COMPA_vect) { BAMOutput::HandleInterrupt(); }
+#else
+#define PLS_BAM_ISR()	// no timer 1 (host build), call HandleInterrupt() yourself
+#endif
+
+#define PLS_WS2812_LATCH_US	300	// time the data line must stay low before the pixels
+					// take the new colors (WS2812B: 280 us, older ones 50 us)
+
+/* This class drives a chain of WS2812 (NeoPixel) pixels from a frame buffer with
+   3 bytes per pixel (green, red, blue as the pixels expect it) that the sketch
+   provides, e.g.
+     byte MyPixels[60 * 3];
+     AddressableStrip Pixels(7, MyPixels, 60);
+   SetPixel and Fill only change the buffer. Show() sends it: every pixel takes the
+   first 24 bits it gets and passes the rest on, so a pixel keeps its color when
+   the data stops before it. That is why only the pixels up to the last one that
+   changed since the last Show() are sent, and nothing at all if no pixel changed.
+   The bits are sent with exact timing, so interrupts are off while they go out:
+   30 us per pixel sent (+ a few us), e.g. 0.3 ms for 10 pixels. Longer than about
+   1 ms makes millis() lose time, so keep the pixels that change often at the start
+   of the chain. Pin change interrupts (InsertCapture) are only delayed.
+   To run the effects of RGBStrip on the pixels, make RGBStrips that are segments of
+   the AddressableStrip (one pixel or many), see RGBStrip(AddressableStrip *, ...).
+   Only 16 MHz AVR boards (Uno, Nano, Mega) are supported. Do not use BAMOutput on
+   other pins of the same port, it writes the whole port from its interrupt.
+*/
+class AddressableStrip
+{
+  public:
+    AddressableStrip(int pin, byte * buffer, unsigned int nrofpixels);
+    void SetPixel(unsigned int index, byte red, byte green, byte blue);
+    void SetPixel(unsigned int index, unsigned long color);
+    unsigned long GetPixel(unsigned int index);
+    void Fill(unsigned int first, unsigned int count, byte red, byte green, byte blue);
+    void Clear();
+    boolean Show();		// false if nothing changed or the pixels are still latching
+    unsigned int GetNrOfPixels();
+    unsigned long GetPixelsSent();	// pixels sent by all calls to Show()
+  private:
+    volatile uint8_t * _port;
+    byte _mask;
+    byte * _buffer;
+    unsigned int _nrofpixels;
+    unsigned int _dirty;		// pixels 0 .. _dirty - 1 have to be sent
+    unsigned long _lastshow;	// micros() at the end of the last Show()
+    unsigned long _pixelssent;
+    static void Send(volatile uint8_t * port, byte mask, const byte * data, unsigned int nrofbytes);
+};
+
+#define PLS_MAX_BANK_INPUTS	32	// one bit per input in an unsigned long
+#define PLS_MAX_BANK_PORTS	6	// different ports (PINB, PINC, ...) per SwitchBank
+#define PLS_NO_INPUT		255
+
+// This class reads many inputs at once. Update() reads every port register (PINB,
+// PINC, PIND, ...) that has a registered input exactly once and keeps the result.
+// All registered inputs are then served from that snapshot, which is much faster
+// than a digitalRead() per input. Call Update() once at the start of loop().
+class SwitchBank
+{
+  public:
+    SwitchBank();
+    byte AddInput(int pin, boolean inverted = false);	// returns the input id or PLS_NO_INPUT
+    void Update();
+    boolean Read(byte id);		// state of one input in the last snapshot
+    unsigned long GetState();		// all inputs of the last snapshot, bit n = input id n
+    byte GetNrOfInputs();
+  private:
+    volatile uint8_t * _portreg[PLS_MAX_BANK_PORTS];
+    byte _portstate[PLS_MAX_BANK_PORTS];
+    byte _nrofports;
+    byte _inputport[PLS_MAX_BANK_INPUTS];	// index into _portreg, bit 7 set for inverted inputs
+    byte _inputmask[PLS_MAX_BANK_INPUTS];	// bit of the input in its port
+    byte _nrofinputs;
+    unsigned long _invert;		// inverted inputs as bit mask
+    unsigned long _state;
+};
+
+/* This class debounces up to 8, 16 or 32 switches at once (use SwitchDebouncer8,
+   SwitchDebouncer16 or SwitchDebouncer32). Every switch has a 2 bit counter, with
+   bit 0 of all counters in one word and bit 1 in another ("vertical counter"), so
+   a handful of logic operations debounce all switches in parallel. A switch only
+   changes its state after 4 equal samples in a row.
+   Feed it with a packed sample, e.g. SwitchBank::GetState() (bit n = input id n).
+   GetRising/GetFalling report the switches that changed in the last Update(),
+   GetHeld the switches that have been closed longer than their hold time (the
+   switchwait of Switch::ReadSwitchDelayed, but reported as long as the switch
+   stays closed). Hold times are limited to 65 seconds.
+*/
+template <class T> class SwitchDebouncerT
+{
+  public:
+    SwitchDebouncerT(byte sampleinterval = 2);	// ms between samples, 4 samples are needed
+    void SetHoldTime(byte id, unsigned int holdtime);
+    void Update(T sample, unsigned long CurrentMillis);
+    T GetState();		// debounced state of all switches
+    T GetRising();		// switches that closed in the last Update()
+    T GetFalling();		// switches that opened in the last Update()
+    T GetHeld();		// switches closed for at least their hold time
+    T GetHeldRising();		// switches that reached their hold time in the last Update()
+  private:
+    T _cnt0;			// bit 0 of the vertical counters
+    T _cnt1;			// bit 1 of the vertical counters
+    T _state;
+    T _rising;
+    T _falling;
+    T _held;
+    T _heldrising;
+    T _pending;			// closed, but hold time not yet reached
+    byte _sampleinterval;
+    unsigned long _lastsample;
+    unsigned int _holdtime[sizeof(T) * 8];
+    unsigned int _closetime[sizeof(T) * 8];	// low 16 bits of millis() when the switch closed
+};
+
+typedef SwitchDebouncerT<uint8_t> SwitchDebouncer8;
+typedef SwitchDebouncerT<uint16_t> SwitchDebouncer16;
+typedef SwitchDebouncerT<uint32_t> SwitchDebouncer32;
+
+template <class T> SwitchDebouncerT<T>::SwitchDebouncerT(byte sampleinterval)
+{
+byte i;
+
+_cnt0 = (T)~0;		// all counters start at 3, i.e. 4 samples until a change
+_cnt1 = (T)~0;
+_state = 0;
+_rising = 0;
+_falling = 0;
+_held = 0;
+_heldrising = 0;
+_pending = 0;
+_sampleinterval = sampleinterval;
+_lastsample = 0;
+for (i=0; i<sizeof(T) * 8; i++)
+  _holdtime[i] = 0;
+}
+
+template <class T> void SwitchDebouncerT<T>::SetHoldTime(byte id, unsigned int holdtime)
+{
+if (id < sizeof(T) * 8)
+  _holdtime[id] = holdtime;
+}
+
+template <class T> void SwitchDebouncerT<T>::Update(T sample, unsigned long CurrentMillis)
+{
+T changed, pending, bit;
+byte i;
+
+_rising = 0;
+_falling = 0;
+_heldrising = 0;
+if (CurrentMillis - _lastsample < _sampleinterval)
+  return;
+_lastsample = CurrentMillis;
+
+// count every switch that differs from its debounced state, reset the others
+changed = _state ^ sample;
+_cnt0 = ~(_cnt0 & changed);
+_cnt1 = _cnt0 ^ (_cnt1 & changed);
+changed &= _cnt0 & _cnt1;		// counter rolled over: 4 samples in a row were different
+_state ^= changed;
+_rising = changed & _state;
+_falling = changed & ~_state;
+
+// hold times: only switches that just closed or are waiting need any work
+_held &= ~_falling;
+_pending = (_pending & ~_falling) | _rising;
+pending = _pending;
+for (i=0, bit=1; pending; i++, bit <<= 1)
+  {
+  if (!(pending & bit))
+    continue;
+  pending &= ~bit;
+  if (_rising & bit)
+    _closetime[i] = (unsigned int)CurrentMillis;
+  if ((unsigned int)((unsigned int)CurrentMillis - _closetime[i]) >= _holdtime[i])
+    {
+    _pending &= ~bit;
+    _held |= bit;
+    _heldrising |= bit;
+    }
+  }
+}
+
+template <class T> T SwitchDebouncerT<T>::GetState()
+{
+return _state;
+}
+
+template <class T> T SwitchDebouncerT<T>::GetRising()
+{
+return _rising;
+}
+
+template <class T> T SwitchDebouncerT<T>::GetFalling()
+{
+return _falling;
+}
+
+template <class T> T SwitchDebouncerT<T>::GetHeld()
+{
+return _held;
+}
+
+template <class T> T SwitchDebouncerT<T>::GetHeldRising()
+{
+return _heldrising;
+}
+
 // This class implements a switch and the methods required to work with it
 class Switch
 {
   public:
-    Switch(int pin, int switchwait = 0);
+    Switch(int pin, unsigned int switchwait = 0);
     boolean ReadSwitch();
     boolean ReadSwitchDelayed(unsigned long CurrentMillis);  // reads a switch but waits a bit before returning true
+    byte UseSwitchBank(SwitchBank * bank);	// read the switch from the snapshot of bank from now on
   private:
+    friend class InputEvents;	// reads the bank id
     int _pin;
-    int _switchwait;
-    int _closetime;
+    unsigned int _switchwait;
+    unsigned long _closetime;
+    boolean _closed;		// switch was already closed at the last call
+    SwitchBank * _bank;
+    byte _bankid;
 };
 
 // This class implements an opto switch and the methods required to work with it
@@ -126,40 +661,741 @@ class Switch
 class OptoSwitch
 {
   public:
-    OptoSwitch(int pin, int switchwait = 0);
+    OptoSwitch(int pin, unsigned int switchwait = 0);
     boolean ReadSwitch();
     boolean ReadSwitchDelayed(unsigned long CurrentMillis);  // reads a switch but waits a bit before returning true
+    byte UseSwitchBank(SwitchBank * bank);	// the bank does the inversion
   private:
+    friend class InputEvents;	// reads the bank id
     int _pin;
-    int _switchwait;
-    int _closetime;
+    unsigned int _switchwait;
+    unsigned long _closetime;
+    boolean _closed;		// opto was already open at the last call
+    SwitchBank * _bank;
+    byte _bankid;
 };
 
 // This class implements an Insert with two methods to read the state of the Insert
 class Insert
 {
   public:
-    Insert(int pin, int FilterDelay, int InsertOnDelay = 0, int InsertOffDelay = 0);
+    Insert(int pin, unsigned int FilterDelay, unsigned int InsertOnDelay = 0, unsigned int InsertOffDelay = 0);
     boolean InsertOn(unsigned long CurrentMillis);
     byte GetBlinkInsertState(unsigned long CurrentMillis);
+    byte UseSwitchBank(SwitchBank * bank);
+    byte EnableEdgeCapture();	// use pin change interrupts, see InsertCapture
+    void SetAdaptiveDelays(boolean adaptive);
+    unsigned int GetStrobePeriod();	// measured period of the lamp matrix pulses in ms (0 = unknown)
+    unsigned int GetBlinkPeriod();	// measured blink period in ms (0 = unknown)
+    unsigned int GetBlinkFrequency();	// measured blink frequency in mHz (0 = unknown)
   private:
+    friend class InsertCapture;
+    friend class EepromConfig;	// sets the delays
     int _pin;
-    int _filterdelay;		// needed because Inserts are not really constantly on
-    int _insertondelay;		// time to wait until we call the Insert "ON" instead of "FLASHING"
-    int _insertoffdelay;	// time to wait until we call the Insert "OFF" instead of "FLASHING"
+    SwitchBank * _bank;
+    byte _bankid;
+    boolean _capture;		// edges come from InsertCapture
+    boolean _capturedlevel;	// pin level after the last captured edge
+    unsigned int _filterdelay;		// needed because Inserts are not really constantly on
+    unsigned int _insertondelay;	// time to wait until we call the Insert "ON" instead of "FLASHING"
+    unsigned int _insertoffdelay;	// time to wait until we call the Insert "OFF" instead of "FLASHING"
     unsigned long _lastinserton;	// last time when Insert was ON
     unsigned long _lastinsertoff;	// last time when Insert was OFF
     byte _state;			// 0 = OFF, 1 = ON, 2 = FLASHING, 3 = UNDEFINED
+  // variables for the blink period estimator
+    boolean _adaptive;		// derive the delays from the measured periods
+    boolean _lastlevel;		// pin level at the last call (to find rising edges when polling)
+    unsigned int _strobeperiod;
+    unsigned int _blinkperiod;
+    unsigned long _lastrise;		// time of the last rising edge
+    unsigned long _lastblinkstart;	// time of the last rising edge that started an ON phase
+    static void (*_processedges)();	// InsertCapture::Process, set by EnableEdgeCapture
+    boolean ReadPin();
+    void HandleEdge(boolean level, unsigned long time);
+    void MeasureRisingEdge(unsigned long time);
+    byte GetAdaptiveState(unsigned long CurrentMillis, boolean inserton);
+};
+
+#define PLS_MAX_STROBE_PERIOD	50	// ms, longer gaps between pulses are not the lamp matrix
+#define PLS_MAX_BLINK_PERIOD	4000	// ms, longer gaps between ON phases are not blinking
+
+#define PLS_MAX_CAPTURED_INSERTS	8
+#define PLS_EDGE_BUFFER_SIZE		32	// power of 2, see PlsRingBuffer
+
+// one captured edge of an Insert pin
+struct InsertEdge
+{
+  byte id;			// index of the Insert in InsertCapture
+  byte level;			// HIGH or LOW after the edge
+  unsigned long time;		// millis() when the edge happened
+};
+
+/* This class catches the edges of Insert pins with pin change interrupts. The lamp
+   matrix only pulses an Insert for a few ms (~25ms on WPC), so when a long effect
+   keeps loop() busy, polling misses pulses. The interrupt routine puts every edge
+   with its time stamp into a lock-free ring buffer; the Inserts take them out the
+   next time InsertOn or GetBlinkInsertState is called, so the result no longer
+   depends on how fast loop() runs.
+   Call Insert::EnableEdgeCapture() in setup() and put PLS_INSERT_CAPTURE_ISR() once
+   into the sketch (outside of any function) to connect the interrupts.
+*/
+class InsertCapture
+{
+  public:
+    static byte Attach(Insert * insert);	// returns the id or PLS_NO_INPUT
+    static void HandleInterrupt();		// called by the pin change interrupt routines
+    static void Process();			// hands all captured edges to their Inserts
+    static byte GetOverflows();			// edges lost because loop() did not process them
+  private:
+    static Insert * _inserts[PLS_MAX_CAPTURED_INSERTS];
+    static volatile uint8_t * _portreg[PLS_MAX_CAPTURED_INSERTS];
+    static byte _mask[PLS_MAX_CAPTURED_INSERTS];
+    static byte _levels;			// last seen level of every Insert, bit n = id n
+    static byte _nrofinserts;
+    static PlsRingBuffer<InsertEdge, PLS_EDGE_BUFFER_SIZE> _edges;
 };
 
+// The interrupt routines are a macro in the sketch and not part of the library, so
+// sketches that use other pin change interrupt code (e.g. SoftwareSerial) still link
+// as long as they don't use PLS_INSERT_CAPTURE_ISR().
+#if defined(PCINT2_vect)
+#define PLS_INSERT_CAPTURE_ISR() \
+  ISR(PCINT0_vect) { InsertCapture::HandleInterrupt(); } \
+  ISR(PCINT1_vect, ISR_ALIASOF(PCINT0_vect)); \
+  ISR(PCINT2_vect, ISR_ALIASOF(PCINT0_vect));
+#elif defined(PCINT0_vect)
+#define PLS_INSERT_CAPTURE_ISR() \
+  ISR(PCINT0_vect) { InsertCapture::HandleInterrupt(); }
+#else
+#define PLS_INSERT_CAPTURE_ISR()	// no pin change interrupts (host build), call HandleInterrupt() yourself
+#endif
+
 // This class provides methods to get the state of Flashers, Coils, Motors and Shakers
 class StdInput
 {
   public:
     StdInput(int pin);
     boolean ReadInput();
+    byte UseSwitchBank(SwitchBank * bank);
   private:
+    friend class InputEvents;	// reads the bank id
     int _pin; 
+    SwitchBank * _bank;
+    byte _bankid;
+};
+
+#define PLS_MAX_POLLED_INPUTS	8	// inputs without a SwitchBank and Inserts
+#define PLS_MAX_EVENT_HANDLERS	4
+#define PLS_EVENT_BUFFER_SIZE	16	// power of 2, see PlsRingBuffer
+#define PLS_ANY_INPUT		254	// the handler gets the events of all inputs
+
+#define PLS_EVENT_PRESS		0	// switch closed, ball at an opto, StdInput activated
+#define PLS_EVENT_RELEASE	1
+#define PLS_EVENT_ON		2	// Insert states, see GetBlinkInsertState
+#define PLS_EVENT_OFF		3
+#define PLS_EVENT_BLINK		4
+
+// one change of an input
+struct PlsEvent
+{
+  byte id;			// input id returned by InputEvents::AddSwitch etc.
+  byte type;			// PLS_EVENT_...
+  unsigned long time;		// millis() of the Update() that found the change
+};
+
+typedef void (*PlsEventHandler)(const PlsEvent & event);
+
+/* This class turns the states of switches, optos, inputs and Inserts into events,
+   so the sketch no longer has to remember the last state of every input to find
+   out what has changed. Update() looks for changes once per pass of loop() and
+   puts an event for each of them into a ring buffer; Dispatch() hands them to the
+   handlers registered with OnEvent (or take them out one by one with GetEvent).
+   Inputs that use a SwitchBank are compared all at once with the last snapshot and
+   only the ones that changed are looked at, so call SwitchBank::Update() before
+   Update(). Inputs without a bank are read one by one and Inserts are asked for
+   their state every time, since it changes with time alone.
+   Only the inputs of the first SwitchBank are taken from the snapshot, they need
+   1 byte of RAM each, the others 5 bytes.
+*/
+class InputEvents
+{
+  public:
+    InputEvents();
+    byte AddSwitch(Switch * sw);		// all return the input id or PLS_NO_INPUT
+    byte AddOptoSwitch(OptoSwitch * opto);
+    byte AddInput(StdInput * input);
+    byte AddInsert(Insert * insert);
+    byte OnEvent(PlsEventHandler handler, byte id = PLS_ANY_INPUT);	// returns PLS_NO_SLOT if full
+    void Update(unsigned long CurrentMillis);
+    boolean GetEvent(PlsEvent * event);	// takes the oldest event out of the buffer
+    byte Dispatch();			// returns the number of events handed to the handlers
+    byte GetOverflows();		// events lost because the buffer was full
+  private:
+    struct Source
+      {
+      union
+        {
+        Switch * sw;
+        OptoSwitch * opto;
+        StdInput * input;
+        Insert * insert;
+        } device;
+      byte id;
+      byte kind;		// how the input is read
+      byte last;		// state at the last Update()
+      };
+    Source _polled[PLS_MAX_POLLED_INPUTS];
+    byte _nrofpolled;
+    byte _nrofinputs;
+    SwitchBank * _bank;
+    byte _bankinput[PLS_MAX_BANK_INPUTS];	// input id of every bank input
+    unsigned long _bankmask;		// bank inputs that have an input id
+    unsigned long _bankstate;		// bank state at the last Update()
+    PlsEventHandler _handlers[PLS_MAX_EVENT_HANDLERS];
+    byte _handlerid[PLS_MAX_EVENT_HANDLERS];
+    byte _nrofhandlers;
+    PlsRingBuffer<PlsEvent, PLS_EVENT_BUFFER_SIZE> _events;
+    byte AddSource(byte kind, SwitchBank * bank, byte bankid, Source ** source);
+    void Queue(byte id, byte type, unsigned long time);
+};
+
+#define PLS_FRAME_SKIP		0	// a late loop() runs one frame, the missed ones are dropped
+#define PLS_FRAME_CATCHUP	1	// a late loop() runs the missed frames one after the other
+
+/* This class gives the effects a fixed update rate (frames per second). Call Due()
+   in every pass of loop(), it returns true when the next frame is due. The effects
+   are then advanced with GetFrameMillis(), the time the frame was due and not the
+   time of the call, so they step once per frame in even steps, however fast or
+   slow loop() runs:
+
+     while (clock.Due())
+       strip.TwoColorFade(clock.GetFrameMillis(), &active);
+
+   The clock runs on micros() and only compares differences of times, so it keeps
+   running when micros() and millis() wrap around. When loop() was late by more
+   than one frame, PLS_FRAME_SKIP drops the missed frames and PLS_FRAME_CATCHUP
+   runs them (at most maxcatchup in a row, the rest is dropped); effects that go
+   one step per call, like TwoColorFade, keep their speed only with catch-up.
+   Effects with steps shorter than a frame go one step per frame.
+*/
+class FrameClock
+{
+  public:
+    FrameClock(unsigned int rate = 100, byte policy = PLS_FRAME_SKIP, byte maxcatchup = 4);
+    void SetRate(unsigned int rate);		// frames per second
+    void SetPolicy(byte policy, byte maxcatchup = 4);
+    boolean Due();
+    unsigned long GetFrameMillis();		// time of the current frame
+    unsigned long GetFrameMicros();
+    unsigned long GetFrames();			// number of frames run
+    unsigned long GetDropped();			// number of frames dropped
+  private:
+    unsigned long _period;	// us per frame
+    unsigned int _periodms;	// _period in whole ms
+    unsigned int _periodus;	// and the us left over
+    unsigned long _next;	// micros() when the next frame is due
+    unsigned long _framemicros;
+    unsigned long _framemillis;
+    unsigned int _restus;	// us of the frame time that do not make a full ms yet
+    unsigned long _frames;
+    unsigned long _dropped;
+    byte _maxcatchup;		// 0 = PLS_FRAME_SKIP
+    byte _catchup;		// late frames run in a row
+    boolean _started;
+    void Advance(unsigned long frames);
+};
+
+#define PLS_MAX_SCHEDULED	8	// max. number of strips + outputs per EffectScheduler
+#define PLS_NO_SLOT		255
+
+// This class drives the effects of many strips and outputs from one call to Tick()
+// in loop(). Tick() reads millis() once and advances every running effect by one step,
+// none of them blocks, so switches can still be read between two calls. With a
+// FrameClock (UseFrameClock) the effects are only advanced when a frame is due.
+class EffectScheduler
+{
+  public:
+    EffectScheduler();
+    byte AddStrip(RGBStrip * strip);		// returns the slot number or PLS_NO_SLOT
+    byte AddOutput(Std12VOutput * output);	// returns the slot number or PLS_NO_SLOT
+    void StartEffect(byte slot, byte effect);
+    void StartPulse(byte slot, int val, unsigned int delaytime);
+    void StopEffect(byte slot);
+    boolean EffectActive(byte slot);
+    void Tick();
+    void UseFrameClock(FrameClock * clock);	// 0 = advance the effects in every Tick()
+    unsigned long GetTickMillis();		// the time used by the last Tick() (or frame)
+    RGBStrip * GetStrip(byte slot);		// 0 if the slot is not a strip
+    Std12VOutput * GetOutput(byte slot);	// 0 if the slot is not an output
+  private:
+    struct Slot
+      {
+      union
+        {
+        RGBStrip * strip;
+        Std12VOutput * output;
+        } device;
+      boolean isstrip;
+      byte effect;
+      boolean active;		// passed to the effect functions, false when they are finished
+      int val;			// parameters of PLS_EFFECT_PULSE
+      unsigned int delaytime;
+      };
+    Slot _slots[PLS_MAX_SCHEDULED];
+    byte _nrofslots;
+    unsigned long _tickmillis;
+    FrameClock * _clock;
+    byte AddSlot();
+    void SwitchOff(Slot * slot);
+    void Advance(unsigned long CurrentMillis);
+};
+
+#define PLS_MAX_GROUP_STRIPS	8	// strips per StripGroup, the leader included
+
+/* This class shows one effect on several strips in sync. The effect only runs on
+   the leader, the strip added first: set it up and run it there as usual (directly,
+   with an EffectScheduler, a ShowPlayer ...) and call Update() afterwards, which
+   writes the color of the leader to all other members. So the effect is computed
+   once per pass of loop() however many strips show it, and the strips can not
+   drift apart. Every member keeps its own brightness and gamma (SetBrightness,
+   SetGamma) and only writes the pins whose value changed.
+   For chase patterns RainbowColorChange runs the rainbow of the leader and gives
+   every member its own position in the rainbow: phase offset 65536 / n puts n
+   members evenly around the color circle. Update() ignores the offsets.
+*/
+class StripGroup
+{
+  public:
+    StripGroup();
+    byte AddStrip(RGBStrip * strip, unsigned int phaseoffset = 0);	// returns the member number or PLS_NO_SLOT
+    void SetPhaseOffset(byte member, unsigned int phaseoffset);
+    RGBStrip * GetLeader();
+    void Update();
+    void RainbowColorChange(unsigned long CurrentMillis);
+  private:
+    RGBStrip * _strips[PLS_MAX_GROUP_STRIPS];
+    unsigned int _offsets[PLS_MAX_GROUP_STRIPS];	// rainbow phase relative to the leader
+    byte _nrofstrips;
+};
+
+#define PLS_MAX_RULES		32	// one bit per rule in an unsigned long, further rules are ignored
+#define PLS_MAX_RULE_INSERTS	8
+#define PLS_RULE_INSERT(n)	(PLS_MAX_BANK_INPUTS + (n))	// input id of the n-th Insert of a RuleEngine
+
+// conditions of a rule: the state the input must have, combined with when the rule fires
+#define PLS_RULE_ENTER		0x00	// start (or restart) the effect when the input gets the state
+#define PLS_RULE_WHILE		0x80	// keep the effect running while the input has the state,
+					// stop it when the input leaves the state
+#define PLS_RULE_PRESSED		(PLS_RULE_ENTER | 1)	// SwitchBank inputs: 1 = set
+#define PLS_RULE_RELEASED		(PLS_RULE_ENTER | 0)
+#define PLS_RULE_WHILE_PRESSED		(PLS_RULE_WHILE | 1)
+#define PLS_RULE_INSERT_OFF		(PLS_RULE_ENTER | 0)	// Inserts: states of GetBlinkInsertState
+#define PLS_RULE_INSERT_ON		(PLS_RULE_ENTER | 1)
+#define PLS_RULE_INSERT_BLINKING	(PLS_RULE_ENTER | 2)
+#define PLS_RULE_WHILE_INSERT_ON	(PLS_RULE_WHILE | 1)
+#define PLS_RULE_WHILE_INSERT_BLINKING	(PLS_RULE_WHILE | 2)
+
+/* A rule set is a table in flash, stored as one array per column (all inputs,
+   then all conditions, ...), so checking the rules only reads the two small
+   columns input and condition; the other columns are only read when a rule
+   fires. Columns a rule set does not need may be 0. What the parameters mean
+   depends on the effect:
+
+     effect                       color1   color2   param1     param2     duration
+     PLS_EFFECT_FLASHES           color    -        flashes    length ms  -
+       (Std12VOutput)             val      -        flashes    length ms  -
+     PLS_EFFECT_TWOCOLORFLASH     color 1  color 2  color 1 ms color 2 ms ms
+     PLS_EFFECT_TWOCOLORFADE      from     to       step       speed ms   ms
+     PLS_EFFECT_RAINBOW           -        -        speed      -          -
+     PLS_EFFECT_PULSE             -        -        val        -          ms
+     PLS_EFFECT_NONE              the slot is stopped
+
+   MultiColorFlash and Keyframes need more than two colors and can not be used.
+   Example: flash strip slot 0 while Insert 0 blinks, pulse output slot 2 when
+   input 5 of the SwitchBank closes:
+
+     const byte MyInputs[] PROGMEM = {PLS_RULE_INSERT(0), 5};
+     const byte MyConditions[] PROGMEM = {PLS_RULE_WHILE_INSERT_BLINKING, PLS_RULE_PRESSED};
+     const byte MySlots[] PROGMEM = {0, 2};
+     const byte MyEffects[] PROGMEM = {PLS_EFFECT_TWOCOLORFLASH, PLS_EFFECT_PULSE};
+     const unsigned long MyColors1[] PROGMEM = {0xFF0000, 0};
+     const unsigned long MyColors2[] PROGMEM = {0x0000FF, 0};
+     const int MyParams1[] PROGMEM = {100, 255};
+     const int MyParams2[] PROGMEM = {100, 0};
+     const unsigned int MyDurations[] PROGMEM = {1000, 300};
+     PlsRuleSet MyRules = {2, MyInputs, MyConditions, MySlots, MyEffects, MyColors1,
+                           MyColors2, MyParams1, MyParams2, MyDurations};
+*/
+struct PlsRuleSet
+{
+  byte nrofrules;
+  const byte * input;			// all arrays in PROGMEM, one entry per rule
+  const byte * condition;
+  const byte * slot;			// slot of the EffectScheduler
+  const byte * effect;
+  const unsigned long * color1;
+  const unsigned long * color2;
+  const int * param1;
+  const int * param2;
+  const unsigned int * duration;
+};
+
+// This class starts and stops the effects of an EffectScheduler as a rule set says.
+// Update() takes one snapshot of the inputs (the state of the SwitchBank and of the
+// Inserts) and checks every rule once against it, the rules themselves stay in flash.
+// Rules further down win when two of them fire for the same slot. Call it once per
+// pass of loop() after SwitchBank::Update() and before EffectScheduler::Tick().
+class RuleEngine
+{
+  public:
+    RuleEngine(EffectScheduler * scheduler, SwitchBank * bank = 0);
+    byte AddInsert(Insert * insert);		// returns the input id or PLS_NO_INPUT
+    void UseRules(const PlsRuleSet * rules);	// stops the effects of the old rules
+    void Update(unsigned long CurrentMillis);
+  private:
+    EffectScheduler * _scheduler;
+    SwitchBank * _bank;
+    const PlsRuleSet * _rules;
+    byte _nrofrules;			// rules of the set that are used, up to PLS_MAX_RULES
+    Insert * _inserts[PLS_MAX_RULE_INSERTS];
+    byte _nrofinserts;
+    unsigned long _bankstate;		// snapshots of the last Update()
+    byte _insertstate[PLS_MAX_RULE_INSERTS];
+    unsigned long _running;		// PLS_RULE_WHILE rules that started their effect
+    byte GetState(byte input, unsigned long bankstate, byte * insertstate);
+    void Fire(byte rule, byte slot);
+};
+
+/* Light shows as byte code in flash memory. A show is a byte array in PROGMEM
+   written with the macros below (durations in ms, up to 65535):
+
+     const byte MyShow[] PROGMEM = {
+       PLS_SHOW_LOOP(3),			// offset 0
+         PLS_SHOW_FLASH(255, 255, 0, 4, 100),	// 4 yellow flashes of 100 ms
+         PLS_SHOW_FADE(0, 0, 255, 1000),		// fade to blue in 1 s
+       PLS_SHOW_NEXT(),
+       PLS_SHOW_IFINPUT(0, 0),			// start again while input 0 is set
+       PLS_SHOW_RAINBOW(1560, 5000),		// 5 s rainbow (rate see SetRainbowRate)
+       PLS_SHOW_END()
+     };
+
+   Jump targets are byte offsets from the start of the show; the number in
+   brackets after every opcode below is the size of the instruction.
+   Loops can be nested PLS_MAX_SHOW_LOOPS deep, a loop nested deeper stops the
+   show (like PLS_OP_END). PLS_SHOW_LOOP(0) loops forever.
+*/
+#define PLS_OP_END	0	// [1] show is over, the strip keeps its color
+#define PLS_OP_COLOR	1	// [4] red, green, blue
+#define PLS_OP_WAIT	2	// [3] ms
+#define PLS_OP_FADE	3	// [6] red, green, blue, ms: linear fade from the current color
+#define PLS_OP_FLASH	4	// [7] red, green, blue, flashes, flash length ms (see Flashes)
+#define PLS_OP_RAINBOW	5	// [5] rate, ms
+#define PLS_OP_LOOP	6	// [2] count (0 = forever), at most PLS_MAX_SHOW_LOOPS nested
+#define PLS_OP_NEXT	7	// [1] end of the loop body
+#define PLS_OP_JUMP	8	// [3] offset
+#define PLS_OP_IFINPUT	9	// [4] SwitchBank input id, offset: jump if the input is set
+
+#define PLS_SHOW_WORD(w)		(byte)((w) & 0xff), (byte)(((w) >> 8) & 0xff)
+#define PLS_SHOW_END()			PLS_OP_END
+#define PLS_SHOW_COLOR(r, g, b)		PLS_OP_COLOR, (r), (g), (b)
+#define PLS_SHOW_WAIT(ms)		PLS_OP_WAIT, PLS_SHOW_WORD(ms)
+#define PLS_SHOW_FADE(r, g, b, ms)	PLS_OP_FADE, (r), (g), (b), PLS_SHOW_WORD(ms)
+#define PLS_SHOW_FLASH(r, g, b, n, ms)	PLS_OP_FLASH, (r), (g), (b), (n), PLS_SHOW_WORD(ms)
+#define PLS_SHOW_RAINBOW(rate, ms)	PLS_OP_RAINBOW, PLS_SHOW_WORD(rate), PLS_SHOW_WORD(ms)
+#define PLS_SHOW_LOOP(n)		PLS_OP_LOOP, (n)
+#define PLS_SHOW_NEXT()			PLS_OP_NEXT
+#define PLS_SHOW_JUMP(offset)		PLS_OP_JUMP, PLS_SHOW_WORD(offset)
+#define PLS_SHOW_IFINPUT(id, offset)	PLS_OP_IFINPUT, (id), PLS_SHOW_WORD(offset)
+
+#define PLS_MAX_SHOW_LOOPS	2	// nesting depth of PLS_SHOW_LOOP
+#define PLS_MAX_SHOW_STEPS	16	// instructions per Update() without a wait in between
+
+// This class plays a show from flash on one RGBStrip. The show is read byte by
+// byte with pgm_read_byte, so it takes no RAM no matter how long it is, and
+// Update() never blocks: call it in every pass of loop().
+class ShowPlayer
+{
+  public:
+    ShowPlayer(RGBStrip * strip);
+    void Start(const byte * show);		// show must be in PROGMEM
+    void Stop();				// the strip keeps its color
+    boolean Running();
+    void UseSwitchBank(SwitchBank * bank);	// inputs for PLS_SHOW_IFINPUT
+    void Update(unsigned long CurrentMillis);
+  private:
+    RGBStrip * _strip;
+    SwitchBank * _bank;
+    const byte * _show;
+    unsigned int _pc;		// offset of the next instruction
+    byte _op;			// timed instruction in progress, PLS_OP_END = none
+    boolean _running;
+    boolean _active;		// for RGBStrip::Flashes
+    unsigned long _starttime;
+    unsigned int _duration;
+    byte _color[3];		// color of the strip, where fades start
+    byte _fadeto[3];
+    byte _fadefrom[3];
+    unsigned int _loopstart[PLS_MAX_SHOW_LOOPS];
+    byte _loopcount[PLS_MAX_SHOW_LOOPS];	// remaining passes, 0 = forever
+    byte _nrofloops;
+    byte NextByte();
+    unsigned int NextWord();
+    void SetColor(byte red, byte green, byte blue);
+    void Execute(unsigned long CurrentMillis);
+    boolean RunTimed(unsigned long CurrentMillis);
+};
+
+#define PLS_FRAME_SYNC		0xA5
+#define PLS_MAX_FRAME_STRIPS	8	// one bit per strip in the mask byte
+
+/* This class lets a PC drive the strips live over Serial. A frame is
+     0xA5, mask, red/green/blue for every strip whose bit is set in mask, CRC-8
+   (the CRC covers mask and colors, see PlsCrc8; bit n of mask is the strip added
+   n-th with AddStrip). A frame for 6 strips has 21 bytes, so 115200 baud carry up
+   to 548 frames/s. Poll() takes the received bytes out of the receive buffer of
+   the serial port and parses them one by one into a fixed buffer, so no frame has
+   to arrive in one piece. Valid frames go straight to RGBStrip::LightStrip,
+   frames with a wrong CRC are dropped and the receiver waits for the next 0xA5.
+   extras/host/framefeed.cpp is a sender for the PC.
+*/
+class FrameReceiver
+{
+  public:
+    FrameReceiver(Stream * stream);		// e.g. &Serial, call Serial.begin(115200) in setup()
+    byte AddStrip(RGBStrip * strip);		// returns the bit of the strip or PLS_NO_SLOT
+    byte Poll();				// returns the number of frames shown
+    unsigned long GetFrames();			// valid frames since the start
+    unsigned long GetErrors();			// frames with a wrong CRC
+  private:
+    Stream * _stream;
+    RGBStrip * _strips[PLS_MAX_FRAME_STRIPS];
+    byte _nrofstrips;
+    byte _state;		// what the next byte is: 0 = sync, 1 = mask, 2 = color, 3 = CRC
+    byte _mask;
+    byte _length;		// number of color bytes of the frame
+    byte _pos;
+    byte _crc;
+    byte _payload[PLS_MAX_FRAME_STRIPS * 3];
+    unsigned long _frames;
+    unsigned long _errors;
+    void ShowFrame();
+};
+
+#define PLS_CONFIG_VERSION	1	// layout of the header and of the records
+#define PLS_CONFIG_HEADER	6	// 'P', 'C', version, length (2 bytes), CRC-8 of the records
+#define PLS_MAX_CONFIG_STRIPS	8
+#define PLS_MAX_CONFIG_INSERTS	8
+
+// records of the config, the object is the number returned by AddStrip/AddInsert
+#define PLS_CONFIG_BRIGHTNESS		1	// brightness, gamma
+#define PLS_CONFIG_RAINBOWSPEED		2	// speed (2 bytes)
+#define PLS_CONFIG_TWOCOLORFADE		3	// from r, g, b, to r, g, b, step, speed (2), duration (2)
+#define PLS_CONFIG_MULTICOLORFLASH	4	// randsequence, duration (2), r, g, b, duration (2) per color
+#define PLS_CONFIG_INSERTDELAYS		5	// filter delay, on delay, off delay (2 bytes each)
+
+/* This class keeps the effect parameters of the strips and the delays of the
+   Inserts in the EEPROM, so they can be changed without uploading the sketch
+   again. Register the objects in setup() and call Load(), it sets up every
+   object a record is stored for; objects without a record keep what the sketch
+   set up. The config is
+     header: 'P', 'C', PLS_CONFIG_VERSION, length of the records (low, high), CRC-8
+     records: type, object, length of the data, data (numbers low byte first)
+   Load() checks the CRC before it changes anything and reads the records byte by
+   byte straight into the objects, so no copy of the config is kept in RAM.
+   Records of unknown types are skipped, so new types need no new version.
+   A config is written with BeginSave(), the Save... methods and EndSave(). Only
+   bytes that changed are written (writing one takes 3.4 ms and wears the
+   EEPROM), and the header is written last: if the board loses power while
+   saving, the CRC does not match and Load() keeps the settings of the sketch.
+*/
+class EepromConfig
+{
+  public:
+    EepromConfig(unsigned int address = 0);	// where the config starts in the EEPROM
+    byte AddStrip(RGBStrip * strip);		// returns the object number or PLS_NO_SLOT
+    byte AddInsert(Insert * insert);		// returns the object number or PLS_NO_SLOT
+    boolean Load();				// false if there is no valid config
+    void BeginSave();
+    void SaveBrightness(byte strip, int brightness, boolean gamma = false);
+    void SaveRainbowSpeed(byte strip, int RainbowSpeed);
+    void SaveTwoColorFade(byte strip, unsigned long fadecolorfrom, unsigned long fadecolorto, int fadestep, unsigned int fadespeed, unsigned int FadeDuration);
+    void SaveMultiColorFlash(byte strip, byte nrofcolors, unsigned long colors[5], unsigned int durations[5], boolean randsequence, unsigned int FlashDuration);
+    void SaveInsertDelays(byte insert, unsigned int FilterDelay, unsigned int InsertOnDelay, unsigned int InsertOffDelay);
+    boolean EndSave();				// false if the config did not fit into the EEPROM
+    unsigned int GetBytesWritten();		// bytes the last save changed
+  private:
+    unsigned int _address;
+    RGBStrip * _strips[PLS_MAX_CONFIG_STRIPS];
+    Insert * _inserts[PLS_MAX_CONFIG_INSERTS];
+    byte _nrofstrips;
+    byte _nrofinserts;
+    unsigned int _pos;		// next address to read or write
+    byte _crc;
+    boolean _full;		// the config being saved did not fit
+    unsigned int _written;
+    byte Read();
+    unsigned int ReadWord();
+    unsigned long ReadColor();
+    void Write(byte data);
+    void WriteWord(unsigned int data);
+    void WriteColor(unsigned long color);
+    void BeginRecord(byte type, byte object, byte length);
+    void Apply(byte type, byte object, byte length);
+};
+
+
+/* ===============================================================
+   Variants of the classes above with the pins as template parameters, e.g.
+     RGBStripT<5, 6, 3> Strip;
+     SwitchT<A0> TroughSwitch;
+   The pins take no RAM and on an ATmega328P (Uno, Nano) port, bit and timer
+   compare register of every pin are known to the compiler, so reading a switch
+   is a single "sbic"/"in" and a PWM value is a single store to OCRnx instead of
+   the table lookups of digitalRead()/analogWrite(). On other boards they fall
+   back to the Arduino functions. They only offer the basic methods, use the
+   classes above for effects, delayed reads and SwitchBanks.
+*/
+#if defined(__AVR_ATmega328P__)
+#define PLS_FAST_PINS
+
+// data space addresses of the ATmega328P: PINx, DDRx = PINx + 1, PORTx = PINx + 2
+constexpr byte PlsPinReg(byte pin) { return pin < 8 ? 0x29 : (pin < 14 ? 0x23 : 0x26); }
+constexpr byte PlsPinMask(byte pin) { return 1 << (pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14)); }
+// timer compare register and its control register TCCRnA, 0 = no PWM on this pin
+constexpr byte PlsPinOCR(byte pin)
+{
+return pin == 3 ? 0xB4 : pin == 5 ? 0x48 : pin == 6 ? 0x47 :
+       pin == 9 ? 0x88 : pin == 10 ? 0x8A : pin == 11 ? 0xB3 : 0;
+}
+constexpr byte PlsPinTCCR(byte pin)
+{
+return (pin == 3 || pin == 11) ? 0xB0 : (pin == 5 || pin == 6) ? 0x44 : 0x80;
+}
+// COMnA1 is bit 7, COMnB1 bit 5 of TCCRnA
+constexpr byte PlsPinCOM(byte pin) { return (pin == 6 || pin == 9 || pin == 11) ? 0x80 : 0x20; }
+
+#define PLS_REG8(addr)	(*(volatile uint8_t *)(addr))
+#define PLS_REG16(addr)	(*(volatile uint16_t *)(addr))
+#endif
+
+template <byte PIN> inline void PlsPinMode(byte mode)
+{
+#if defined(PLS_FAST_PINS)
+static_assert(PIN < 20, "no such pin on the ATmega328P");
+if (mode == OUTPUT)
+  PLS_REG8(PlsPinReg(PIN) + 1) |= PlsPinMask(PIN);
+else
+  {
+  PLS_REG8(PlsPinReg(PIN) + 1) &= ~PlsPinMask(PIN);
+  PLS_REG8(PlsPinReg(PIN) + 2) &= ~PlsPinMask(PIN);	// no pull up, like pinMode(pin, INPUT)
+  }
+#else
+pinMode(PIN, mode);
+#endif
+}
+
+template <byte PIN> inline boolean PlsPinRead()
+{
+#if defined(PLS_FAST_PINS)
+return (PLS_REG8(PlsPinReg(PIN)) & PlsPinMask(PIN)) != 0;
+#else
+return digitalRead(PIN);
+#endif
+}
+
+// same as analogWrite(): 0 and 255 switch the PWM off and the pin LOW or HIGH
+template <byte PIN> inline void PlsPinPWM(byte val)
+{
+#if defined(PLS_FAST_PINS)
+static_assert(PlsPinOCR(PIN) != 0, "pin has no PWM");
+if (val == 0 || val == 255)
+  {
+  PLS_REG8(PlsPinTCCR(PIN)) &= ~PlsPinCOM(PIN);
+  if (val)
+    PLS_REG8(PlsPinReg(PIN) + 2) |= PlsPinMask(PIN);
+  else
+    PLS_REG8(PlsPinReg(PIN) + 2) &= ~PlsPinMask(PIN);
+  }
+else
+  {
+  if (PIN == 9 || PIN == 10)	// timer 1 has 16 bit compare registers
+    PLS_REG16(PlsPinOCR(PIN)) = val;
+  else
+    PLS_REG8(PlsPinOCR(PIN)) = val;
+  PLS_REG8(PlsPinTCCR(PIN)) |= PlsPinCOM(PIN);
+  }
+#else
+analogWrite(PIN, val);
+#endif
+}
+
+template <byte REDPIN, byte GREENPIN, byte BLUEPIN> class RGBStripT
+{
+  public:
+    RGBStripT(int brightness = 100)
+      {
+      PlsPinMode<REDPIN>(OUTPUT);
+      PlsPinMode<GREENPIN>(OUTPUT);
+      PlsPinMode<BLUEPIN>(OUTPUT);
+      SetBrightness(brightness);
+      SwitchOff();
+      }
+    void LightStrip(unsigned long color)
+      {
+      LightStrip(GetRed(color), GetGreen(color), GetBlue(color));
+      }
+    void LightStrip(int redval, int greenval, int blueval)
+      {
+      PlsPinPWM<REDPIN>(ScaleColor(redval));
+      PlsPinPWM<GREENPIN>(ScaleColor(greenval));
+      PlsPinPWM<BLUEPIN>(ScaleColor(blueval));
+      }
+    void SwitchOff()
+      {
+      PlsPinPWM<REDPIN>(0);
+      PlsPinPWM<GREENPIN>(0);
+      PlsPinPWM<BLUEPIN>(0);
+      }
+    void SetBrightness(int brightness)	// same scaling as RGBStrip::SetBrightness
+      {
+      if (brightness < 0 || brightness > 100)
+        brightness = 100;
+      _brightscale = ((unsigned int)brightness * 256 + 50) / 100;
+      }
+  private:
+    unsigned int _brightscale;		// 256 = 100%
+    byte ScaleColor(int val)
+      {
+      return ((unsigned int)constrain(val, 0, 255) * _brightscale) >> 8;
+      }
+};
+
+template <byte PIN> class Std12VOutputT
+{
+  public:
+    Std12VOutputT() { PlsPinMode<PIN>(OUTPUT); Output(0); }
+    void Output(int val) { PlsPinPWM<PIN>(constrain(val, 0, 255)); }
+};
+
+template <byte PIN> class SwitchT
+{
+  public:
+    SwitchT() { PlsPinMode<PIN>(INPUT); }
+    boolean ReadSwitch() { return PlsPinRead<PIN>(); }	// true for a closed switch
+};
+
+template <byte PIN> class OptoSwitchT
+{
+  public:
+    OptoSwitchT() { PlsPinMode<PIN>(INPUT); }
+    boolean ReadSwitch() { return !PlsPinRead<PIN>(); }	// true if a ball is present
+};
+
+template <byte PIN> class StdInputT
+{
+  public:
+    StdInputT() { PlsPinMode<PIN>(INPUT); }
+    boolean ReadInput() { return PlsPinRead<PIN>(); }
 };
 
 #endif